@@ -11,11 +11,112 @@
 #include "PN532_debug.h"
 #include <string.h>
 
+#ifdef PN532_TRANSPORT
+// The build uses one transport class: call it directly instead of
+// through the PN532Interface vtable, so the frame path can be inlined
+#define HAL(func)   (_interface->PN532_TRANSPORT::func)
+#else
 #define HAL(func)   (_interface->func)
+#endif
+
+/**************************************************************************/
+/*!
+    Sends a command through the transport, keeping its outcome in the
+    status (see getStatus)
+*/
+/**************************************************************************/
+int8_t PN532::writeCommand(const uint8_t *header, uint8_t hlen, const uint8_t *body, uint8_t blen)
+{
+    int8_t result = HAL(writeCommand)(header, hlen, body, blen);
+
+    _status.transport = result;
+    _status.error = PN532_ERROR_NONE;
+
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    Reads a response through the transport, keeping its outcome in the
+    status (see getStatus)
+*/
+/**************************************************************************/
+int16_t PN532::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
+{
+    int16_t result = HAL(readResponse)(buf, len, timeout);
+
+    if (result < 0) {
+        _status.transport = result;
+    }
+
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    Keeps the error code of a PN532 status byte in the status
+
+    @returns The error code, PN532_ERROR_NONE if the command succeeded
+*/
+/**************************************************************************/
+uint8_t PN532::checkStatus(uint8_t status)
+{
+    _status.error = status & PN532_ERROR_MASK;
+
+    return _status.error;
+}
+
+// Power up values
+const pn532_rf_config_t PN532_RF_DEFAULT = {
+    PN532_RF_TIMEOUT_102_4MS, PN532_RF_TIMEOUT_51_2MS, 0x00,
+    0xFF, 0x01, PN532_RF_RETRY_FOREVER
+};
+
+// Short timeouts and a couple of activation tries, so a poll returns as
+// soon as no card answers
+const pn532_rf_config_t PN532_RF_FAST_UID_POLL = {
+    PN532_RF_TIMEOUT_102_4MS, PN532_RF_TIMEOUT_12_8MS, 0x00,
+    0xFF, 0x01, 0x01
+};
+
+// Longer timeouts and retries for cards at the edge of the field
+const pn532_rf_config_t PN532_RF_ROBUST_LONG_RANGE = {
+    PN532_RF_TIMEOUT_409_6MS, PN532_RF_TIMEOUT_204_8MS, 0x03,
+    0xFF, 0x03, PN532_RF_RETRY_FOREVER
+};
+
+#if PN532_PACKETBUFFER_SIZE == 0
+// Stands in for a missing or too small buffer, so commands never write
+// through a null pointer or below the frame overhead
+static uint8_t fallbackBuffer[PN532_PACKETBUFFER_MIN];
+#endif
 
-PN532::PN532(PN532Interface &interface)
+PN532::PN532(PN532Transport &interface, uint8_t *buffer, uint8_t size)
 {
     _interface = &interface;
+    if (!buffer || size < PN532_PACKETBUFFER_MIN) {
+#if PN532_PACKETBUFFER_SIZE > 0
+        buffer = _packetBuffer;
+        size = sizeof(_packetBuffer);
+#else
+        buffer = fallbackBuffer;
+        size = sizeof(fallbackBuffer);
+#endif
+    }
+    pn532_packetbuffer = buffer;
+    _packetBufferSize = size;
+    _status.transport = 0;
+    _status.error = PN532_ERROR_NONE;
+    _uidLen = 0;
+    _atsLen = 0;
+    _sak = 0;
+    _targetUidLen = 0;
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _authKeyNumber = 0;
+    inListedTag = 1;
+    _type4Mle = 0;
+    _type4Mlc = 0;
+    _felicaStatus = 0;
 }
 
 /**************************************************************************/
@@ -119,12 +220,12 @@ uint32_t PN532::getFirmwareVersion(void)
 
     pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 1)) {
+    if (writeCommand(pn532_packetbuffer, 1)) {
         return 0;
     }
 
     // read data packet
-    int16_t status = HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
     if (0 > status) {
         return 0;
     }
@@ -177,10 +278,10 @@ bool PN532::writeGPIO(uint8_t pinstate)
     DMSG("\n");
 
     // Send the WRITEGPIO command (0x0E)
-    if (HAL(writeCommand)(pn532_packetbuffer, 3))
+    if (writeCommand(pn532_packetbuffer, 3))
         return 0;
 
-    return (0 < HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer)));
+    return (0 < readResponse(pn532_packetbuffer, _packetBufferSize));
 }
 
 /**************************************************************************/
@@ -202,10 +303,10 @@ uint8_t PN532::readGPIO(void)
     pn532_packetbuffer[0] = PN532_COMMAND_READGPIO;
 
     // Send the READGPIO command (0x0C)
-    if (HAL(writeCommand)(pn532_packetbuffer, 1))
+    if (writeCommand(pn532_packetbuffer, 1))
         return 0x0;
 
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    readResponse(pn532_packetbuffer, _packetBufferSize);
 
     /* READGPIO response without prefix and suffix should be in the following format:
 
@@ -239,10 +340,10 @@ bool PN532::SAMConfig(void)
 
     DMSG("SAMConfig\n");
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 4))
+    if (writeCommand(pn532_packetbuffer, 4))
         return false;
 
-    return (0 < HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer)));
+    return (0 < readResponse(pn532_packetbuffer, _packetBufferSize));
 }
 
 /**************************************************************************/
@@ -256,171 +357,232 @@ bool PN532::SAMConfig(void)
 */
 /**************************************************************************/
 bool PN532::setPassiveActivationRetries(uint8_t maxRetries)
+{
+    return setMaxRetries(0xFF, 0x01, maxRetries);  // MxRtyATR and MxRtyPSL defaults
+}
+
+/**************************************************************************/
+/*!
+    Sends one RFConfiguration item
+
+    @param  item          Config item (PN532_RF_ITEM_xxx or PN532_RF_ANALOG_xxx)
+    @param  data          Config data of the item
+    @param  length        Length of the config data
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::rfConfiguration(uint8_t item, const uint8_t *data, uint8_t length)
 {
     pn532_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
-    pn532_packetbuffer[1] = 5;    // Config item 5 (MaxRetries)
-    pn532_packetbuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
-    pn532_packetbuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
-    pn532_packetbuffer[4] = maxRetries;
+    pn532_packetbuffer[1] = item;
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 5))
+    if (writeCommand(pn532_packetbuffer, 2, data, length))
         return 0x0;  // no ACK
 
-    return (0 < HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer)));
+    return (0 <= readResponse(pn532_packetbuffer, _packetBufferSize));
 }
 
-/***** ISO14443A Commands ******/
+/**************************************************************************/
+/*!
+    Switches the RF field on or off
+
+    @param  field         PN532_RF_FIELD_ON and/or PN532_RF_FIELD_AUTO_RFCA
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::setRFField(uint8_t field)
+{
+    return rfConfiguration(PN532_RF_ITEM_FIELD, &field, 1);
+}
 
 /**************************************************************************/
 /*!
-    Waits for an ISO14443A target to enter the field
+    Sets the timeouts of the PN532 waiting for a target
 
-    @param  cardBaudRate  Baud rate of the card
-    @param  uid           Pointer to the array that will be populated
-                          with the card's UID (up to 7 bytes)
-    @param  uidLength     Pointer to the variable that will hold the
-                          length of the card's UID.
-    @param  timeout       The number of tries before timing out
-    @param  inlist        If set to true, the card will be inlisted
+    @param  atrResTimeout Timeout for ATR_RES (PN532_RF_TIMEOUT_xxx)
+    @param  retryTimeout  Timeout of an exchange with a target outside of
+                          DEP, before a retry (PN532_RF_TIMEOUT_xxx)
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-bool PN532::readPassiveTargetID(uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout, bool inlist)
+bool PN532::setTimings(uint8_t atrResTimeout, uint8_t retryTimeout)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    pn532_packetbuffer[1] = 1;  // max 1 cards at once (we can set this to 2 later)
-    pn532_packetbuffer[2] = cardbaudrate;
+    uint8_t timings[3] = {0x00, atrResTimeout, retryTimeout};  // RFU, ATR_RES, non-DEP
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 3)) {
-        return 0x0;  // command failed
-    }
+    return rfConfiguration(PN532_RF_ITEM_TIMINGS, timings, sizeof(timings));
+}
 
-    // read data packet
-    if (HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer), timeout) < 0) {
-        return 0x0;
-    }
+/**************************************************************************/
+/*!
+    Sets the number of retries of InDataExchange and InCommunicateThru
+    when the target doesn't answer (MaxRtyCOM, 0 by default)
 
-    // check some basic stuff
-    /* ISO14443A card response should be in the following format:
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::setMaxRtyCOM(uint8_t maxRetries)
+{
+    return rfConfiguration(PN532_RF_ITEM_MAXRTYCOM, &maxRetries, 1);
+}
 
-      byte            Description
-      -------------   ------------------------------------------
-      b0              Tags Found
-      b1              Tag Number (only one used in this example)
-      b2..3           SENS_RES
-      b4              SEL_RES
-      b5              NFCID Length
-      b6..NFCIDLen    NFCID
-    */
+/**************************************************************************/
+/*!
+    Sets the number of retries of the activation of a target
 
-    if (pn532_packetbuffer[0] != 1)
-        return 0;
+    @param  maxRtyATR     ATR_REQ retries (default 0xFF)
+    @param  maxRtyPSL     PSL_REQ retries (default 0x01)
+    @param  maxRtyPassiveActivation  InListPassiveTarget retries,
+                          PN532_RF_RETRY_FOREVER by default
 
-    uint16_t sens_res = pn532_packetbuffer[2];
-    sens_res <<= 8;
-    sens_res |= pn532_packetbuffer[3];
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::setMaxRetries(uint8_t maxRtyATR, uint8_t maxRtyPSL, uint8_t maxRtyPassiveActivation)
+{
+    uint8_t retries[3] = {maxRtyATR, maxRtyPSL, maxRtyPassiveActivation};
 
-    DMSG("ATQA: 0x");  DMSG_HEX(sens_res);
-    DMSG("SAK: 0x");  DMSG_HEX(pn532_packetbuffer[4]);
-    DMSG("\n");
+    return rfConfiguration(PN532_RF_ITEM_MAXRETRIES, retries, sizeof(retries));
+}
 
-    /* Card appears to be Mifare Classic */
-    *uidLength = pn532_packetbuffer[5];
+/**************************************************************************/
+/*!
+    Sets the analog registers (CIU) used for a modulation type
 
-    for (uint8_t i = 0; i < pn532_packetbuffer[5]; i++) {
-        uid[i] = pn532_packetbuffer[6 + i];
-    }
+    @param  item          PN532_RF_ANALOG_xxx
+    @param  settings      Register values in the order of the user manual:
+                          11 bytes for 106A, 8 for 212/424, 3 for type B
+                          and 9 for ISO14443-4 at 212/424/848 kbps
 
-    if (inlist) {
-        inListedTag = pn532_packetbuffer[1];
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::setAnalogSettings(uint8_t item, const uint8_t *settings)
+{
+    uint8_t length;
+
+    switch (item) {
+    case PN532_RF_ANALOG_106A:
+        length = 11;
+        break;
+    case PN532_RF_ANALOG_212_424:
+        length = 8;
+        break;
+    case PN532_RF_ANALOG_TYPEB:
+        length = 3;
+        break;
+    case PN532_RF_ANALOG_ISO14443_4:
+        length = 9;
+        break;
+    default:
+        return 0;
     }
 
-    return 1;
+    return rfConfiguration(item, settings, length);
 }
 
+/**************************************************************************/
+/*!
+    Applies timings and retries at once, e.g. PN532_RF_FAST_UID_POLL
 
-/***** Mifare Classic Functions ******/
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::setRFConfig(const pn532_rf_config_t *config)
+{
+    return setTimings(config->atrResTimeout, config->retryTimeout) &&
+           setMaxRtyCOM(config->maxRtyCOM) &&
+           setMaxRetries(config->maxRtyATR, config->maxRtyPSL, config->maxRtyPassiveActivation);
+}
 
 /**************************************************************************/
 /*!
-      Indicates whether the specified block number is the first block
-      in the sector (block 0 relative to the current sector)
+    Sets the internal parameters of the PN532 (SetParameters)
+
+    @param  flags         PN532_PARAM_xxx flags; those not given are
+                          cleared, the power up value is
+                          PN532_PARAM_AUTO_ATR_RES | PN532_PARAM_AUTO_RATS
+
+    @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-bool PN532::mifareclassic_IsFirstBlock (uint32_t uiBlock)
+bool PN532::setParameters(uint8_t flags)
 {
-    // Test if we are in the small or big sectors
-    if (uiBlock < 128)
-        return ((uiBlock) % 4 == 0);
-    else
-        return ((uiBlock) % 16 == 0);
+    pn532_packetbuffer[0] = PN532_COMMAND_SETPARAMETERS;
+    pn532_packetbuffer[1] = flags;
+
+    if (writeCommand(pn532_packetbuffer, 2))
+        return 0x0;  // no ACK
+
+    return (0 <= readResponse(pn532_packetbuffer, _packetBufferSize));
 }
 
 /**************************************************************************/
 /*!
-      Indicates whether the specified block number is the sector trailer
+    Reads one SFR or CIU register (ReadRegister)
+
+    @param  address       PN532_REG_xxx
+    @param  value         The value (out)
+
+    @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-bool PN532::mifareclassic_IsTrailerBlock (uint32_t uiBlock)
+bool PN532::readRegister(uint16_t address, uint8_t *value)
 {
-    // Test if we are in the small or big sectors
-    if (uiBlock < 128)
-        return ((uiBlock + 1) % 4 == 0);
-    else
-        return ((uiBlock + 1) % 16 == 0);
+    return readRegisters(&address, 1, value);
 }
 
 /**************************************************************************/
 /*!
-    Tries to authenticate a block of memory on a MIFARE card using the
-    INDATAEXCHANGE command.  See section 7.3.8 of the PN532 User Manual
-    for more information on sending MIFARE and other commands.
+    Writes one SFR or CIU register (WriteRegister)
 
-    @param  uid           Pointer to a byte array containing the card UID
-    @param  uidLen        The length (in bytes) of the card's UID (Should
-                          be 4 for MIFARE Classic)
-    @param  blockNumber   The block number to authenticate.  (0..63 for
-                          1KB cards, and 0..255 for 4KB cards).
-    @param  keyNumber     Which key type to use during authentication
-                          (0 = MIFARE_CMD_AUTH_A, 1 = MIFARE_CMD_AUTH_B)
-    @param  keyData       Pointer to a byte array containing the 6 bytes
-                          key value
+    @param  address       PN532_REG_xxx
+    @param  value         The value
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareclassic_AuthenticateBlock (uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, uint8_t *keyData)
+bool PN532::writeRegister(uint16_t address, uint8_t value)
 {
-    uint8_t i;
+    pn532_register_t reg = { address, value };
 
-    // Hang on to the key and uid data
-    memcpy (_key, keyData, 6);
-    memcpy (_uid, uid, uidLen);
-    _uidLen = uidLen;
+    return writeRegisters(&reg, 1);
+}
 
-    // Prepare the authentication command //
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;   /* Data Exchange Header */
-    pn532_packetbuffer[1] = 1;                              /* Max card numbers */
-    pn532_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
-    pn532_packetbuffer[3] = blockNumber;                    /* Block Number (1K = 0..63, 4K = 0..255 */
-    memcpy (pn532_packetbuffer + 4, _key, 6);
-    for (i = 0; i < _uidLen; i++) {
-        pn532_packetbuffer[10 + i] = _uid[i];              /* 4 bytes card ID */
-    }
+/**************************************************************************/
+/*!
+    Reads registers, as many per ReadRegister command as
+    pn532_packetbuffer holds (31 with 64 bytes)
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 10 + _uidLen))
-        return 0;
+    @param  addresses     PN532_REG_xxx to read
+    @param  count         Number of registers
+    @param  values        Receives count values, in order
 
-    // Read the response packet
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::readRegisters(const uint16_t *addresses, uint8_t count, uint8_t *values)
+{
+    uint8_t perCommand = (_packetBufferSize - 1) / 2;
 
-    // Check if the response is valid and we are authenticated???
-    // for an auth success it should be bytes 5-7: 0xD5 0x41 0x00
-    // Mifare auth error is technically byte 7: 0x14 but anything other and 0x00 is not good
-    if (pn532_packetbuffer[0] != 0x00) {
-        DMSG("Authentification failed\n");
-        return 0;
+    while (count) {
+        uint8_t n = (count < perCommand) ? count : perCommand;
+
+        for (uint8_t i = 0; i < n; i++) {
+            pn532_packetbuffer[1 + 2 * i] = addresses[i] >> 8;
+            pn532_packetbuffer[2 + 2 * i] = addresses[i] & 0xFF;
+        }
+
+        if (!readRegisterBatch(n)) {
+            return 0;
+        }
+        memcpy(values, pn532_packetbuffer, n);
+
+        addresses += n;
+        values += n;
+        count -= n;
     }
 
     return 1;
@@ -428,299 +590,2361 @@ uint8_t PN532::mifareclassic_AuthenticateBlock (uint8_t *uid, uint8_t uidLen, ui
 
 /**************************************************************************/
 /*!
-    Tries to read an entire 16-bytes data block at the specified block
-    address.
+    Writes registers, as many per WriteRegister command as
+    pn532_packetbuffer holds (21 with 64 bytes), so a tuning profile
+    usually takes one exchange
 
-    @param  blockNumber   The block number to authenticate.  (0..63 for
-                          1KB cards, and 0..255 for 4KB cards).
-    @param  data          Pointer to the byte array that will hold the
-                          retrieved data (if any)
+    @param  registers     Addresses and values, written in order
+    @param  count         Number of registers
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareclassic_ReadDataBlock (uint8_t blockNumber, uint8_t *data)
+bool PN532::writeRegisters(const pn532_register_t *registers, uint8_t count)
 {
-    DMSG("Trying to read 16 bytes from block ");
-    DMSG_INT(blockNumber);
+    uint8_t perCommand = (_packetBufferSize - 1) / 3;
 
-    /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                      /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ;        /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = blockNumber;            /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    while (count) {
+        uint8_t n = (count < perCommand) ? count : perCommand;
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, 4)) {
-        return 0;
-    }
+        pn532_packetbuffer[0] = PN532_COMMAND_WRITEREGISTER;
+        for (uint8_t i = 0; i < n; i++) {
+            pn532_packetbuffer[1 + 3 * i] = registers[i].address >> 8;
+            pn532_packetbuffer[2 + 3 * i] = registers[i].address & 0xFF;
+            pn532_packetbuffer[3 + 3 * i] = registers[i].value;
+        }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+        if (writeCommand(pn532_packetbuffer, 1 + 3 * n)) {
+            return 0;
+        }
 
-    /* If byte 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[0] != 0x00) {
-        return 0;
-    }
+        if (0 > readResponse(pn532_packetbuffer, _packetBufferSize)) {
+            return 0;
+        }
 
-    /* Copy the 16 data bytes to the output buffer        */
-    /* Block content starts at byte 9 of a valid response */
-    memcpy (data, pn532_packetbuffer + 1, 16);
+        registers += n;
+        count -= n;
+    }
 
     return 1;
 }
 
 /**************************************************************************/
 /*!
-    Tries to write an entire 16-bytes data block at the specified block
-    address.
+    Reads the current values of registers, e.g. before applying a tuning
+    profile; restoreRegisters writes them back
 
-    @param  blockNumber   The block number to authenticate.  (0..63 for
-                          1KB cards, and 0..255 for 4KB cards).
-    @param  data          The byte array that contains the data to write.
+    @param  registers     Addresses to read, values filled in
+    @param  count         Number of registers
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareclassic_WriteDataBlock (uint8_t blockNumber, uint8_t *data)
+bool PN532::snapshotRegisters(pn532_register_t *registers, uint8_t count)
 {
-    /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                      /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_WRITE;       /* Mifare Write command = 0xA0 */
-    pn532_packetbuffer[3] = blockNumber;            /* Block Number (0..63 for 1K, 0..255 for 4K) */
-    memcpy (pn532_packetbuffer + 4, data, 16);        /* Data Payload */
+    uint8_t perCommand = (_packetBufferSize - 1) / 2;
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, 20)) {
-        return 0;
+    while (count) {
+        uint8_t n = (count < perCommand) ? count : perCommand;
+
+        for (uint8_t i = 0; i < n; i++) {
+            pn532_packetbuffer[1 + 2 * i] = registers[i].address >> 8;
+            pn532_packetbuffer[2 + 2 * i] = registers[i].address & 0xFF;
+        }
+
+        if (!readRegisterBatch(n)) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < n; i++) {
+            registers[i].value = pn532_packetbuffer[i];
+        }
+
+        registers += n;
+        count -= n;
     }
 
-    /* Read the response packet */
-    return (0 < HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer)));
+    return 1;
 }
 
 /**************************************************************************/
 /*!
-    Formats a Mifare Classic card to store NDEF Records
-
-    @returns 1 if everything executed properly, 0 for an error
+    Sends a ReadRegister command for the count addresses already in
+    pn532_packetbuffer; the values are left at its start
 */
 /**************************************************************************/
-uint8_t PN532::mifareclassic_FormatNDEF (void)
+bool PN532::readRegisterBatch(uint8_t count)
 {
-    uint8_t sectorbuffer1[16] = {0x14, 0x01, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
-    uint8_t sectorbuffer2[16] = {0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
-    uint8_t sectorbuffer3[16] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0x78, 0x77, 0x88, 0xC1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    pn532_packetbuffer[0] = PN532_COMMAND_READREGISTER;
 
-    // Note 0xA0 0xA1 0xA2 0xA3 0xA4 0xA5 must be used for key A
+    if (writeCommand(pn532_packetbuffer, 1 + 2 * count)) {
+        return 0;
+    }
+
+    // One value per register, no status byte
+    return count == readResponse(pn532_packetbuffer, _packetBufferSize);
+}
+
+/***** ISO14443A Commands ******/
+
+/**************************************************************************/
+/*!
+    Waits for an ISO14443A target to enter the field
+
+    @param  cardBaudRate  Baud rate of the card
+    @param  uid           Pointer to the array that will be populated
+                          with the card's UID (up to 7 bytes)
+    @param  uidLength     Pointer to the variable that will hold the
+                          length of the card's UID.
+    @param  timeout       The number of tries before timing out
+    @param  inlist        If set to true, the card will be inlisted
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::readPassiveTargetID(uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout, bool inlist)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    pn532_packetbuffer[1] = 1;  // max 1 cards at once (we can set this to 2 later)
+    pn532_packetbuffer[2] = cardbaudrate;
+
+    if (writeCommand(pn532_packetbuffer, 3)) {
+        return 0x0;  // command failed
+    }
+
+    // read data packet
+    int16_t length = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (length < 0) {
+        return 0x0;
+    }
+
+    // check some basic stuff
+    /* ISO14443A card response should be in the following format:
+
+      byte            Description
+      -------------   ------------------------------------------
+      b0              Tags Found
+      b1              Tag Number (only one used in this example)
+      b2..3           SENS_RES
+      b4              SEL_RES
+      b5              NFCID Length
+      b6..NFCIDLen    NFCID
+      ...             ATS, for ISO14443-4 cards
+    */
+
+    // A new activation drops any Mifare Classic authentication
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (pn532_packetbuffer[0] != 1)
+        return 0;
+
+    if (cardbaudrate == PN532_MIFARE_ISO14443A) {
+        recordTarget(length);
+    }
+
+    uint16_t sens_res = pn532_packetbuffer[2];
+    sens_res <<= 8;
+    sens_res |= pn532_packetbuffer[3];
+
+    DMSG("ATQA: 0x");  DMSG_HEX(sens_res);
+    DMSG("SAK: 0x");  DMSG_HEX(pn532_packetbuffer[4]);
+    DMSG("\n");
+
+    /* Card appears to be Mifare Classic */
+    *uidLength = pn532_packetbuffer[5];
+
+    for (uint8_t i = 0; i < pn532_packetbuffer[5]; i++) {
+        uid[i] = pn532_packetbuffer[6 + i];
+    }
+
+    if (inlist) {
+        inListedTag = pn532_packetbuffer[1];
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Re-activates a known ISO14443A target, e.g. a Mifare Classic card
+    that fell back to idle after a failed authentication.  The uid is
+    passed as InitiatorData, so the PN532 selects that card directly
+    instead of running a full anticollision.  Double and triple size
+    uids are sent in their cascaded form, with the cascade tag 0x88
+    before each cascade level but the last.
+
+    @param  uid           Pointer to the card's UID (4, 7 or 10 bytes)
+    @param  uidLength     Length of the UID
+    @param  timeout       Time to wait for the response in ms
+
+    @returns 1 if the card answered, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::reselectPassiveTarget(const uint8_t *uid, uint8_t uidLength, uint16_t timeout)
+{
+    if (uidLength != 4 && uidLength != 7 && uidLength != 10) {
+        return 0;
+    }
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    pn532_packetbuffer[1] = 1;
+    pn532_packetbuffer[2] = PN532_MIFARE_ISO14443A;
+
+    // 4 bytes: UID; 7 bytes: CT UID0-2 UID3-6; 10 bytes: CT UID0-2 CT UID3-5 UID6-9
+    uint8_t length = 3;
+    for (uint8_t i = 0; i < uidLength; ) {
+        uint8_t remaining = uidLength - i;
+        if (remaining > 4) {
+            pn532_packetbuffer[length++] = PN532_CASCADE_TAG;
+            memcpy(pn532_packetbuffer + length, uid + i, 3);
+            length += 3;
+            i += 3;
+        } else {
+            memcpy(pn532_packetbuffer + length, uid + i, remaining);
+            length += remaining;
+            i += remaining;
+        }
+    }
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (writeCommand(pn532_packetbuffer, length)) {
+        return 0;
+    }
+
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (status < 2) {
+        return 0;
+    }
+
+    if (pn532_packetbuffer[0] != 1) {
+        return 0;
+    }
+
+    inListedTag = pn532_packetbuffer[1];
+    recordTarget(status);
+
+    return 1;
+}
+
+
+/**************************************************************************/
+/*!
+    Puts a target to sleep so it no longer answers a poll: DESELECT for
+    an ISO14443-4 card, HLTA otherwise.  A card doesn't answer HLTA, so
+    the timeout status of InCommunicateThru is expected.
+*/
+/**************************************************************************/
+bool PN532::haltTarget(uint8_t tg, bool iso14443_4)
+{
+    uint8_t length = 2;
+
+    if (iso14443_4) {
+        pn532_packetbuffer[0] = PN532_COMMAND_INDESELECT;
+        pn532_packetbuffer[1] = tg;
+    } else {
+        pn532_packetbuffer[0] = PN532_COMMAND_INCOMMUNICATETHRU;
+        pn532_packetbuffer[1] = 0x50;   // HLTA, the PN532 adds the CRC
+        pn532_packetbuffer[2] = 0x00;
+        length = 3;
+    }
+
+    if (writeCommand(pn532_packetbuffer, length)) {
+        return 0;
+    }
+
+    return 0 < readResponse(pn532_packetbuffer, _packetBufferSize);
+}
+
+/**************************************************************************/
+/*!
+    Lists every ISO14443A card in the field, not only the one winning the
+    anticollision.  Cards are polled two at a time and put to sleep (HLTA
+    or DESELECT) once listed, until a poll finds no new card or the time
+    budget runs out.  The cards are left asleep: take them out of the
+    field, or wake one with reselectPassiveTarget, to use them.
+
+    Polls must give up when the field is empty, so set a finite number
+    of passive activation retries first (e.g. PN532_RF_FAST_UID_POLL).
+
+    @param  targets       Array getting the cards found
+    @param  maxTargets    Size of the array
+    @param  budget        Time budget in ms
+
+    @returns The number of cards found
+*/
+/**************************************************************************/
+uint8_t PN532::inventoryPassiveTargets(iso14443a_target_t *targets, uint8_t maxTargets, uint16_t budget)
+{
+    unsigned long start = millis();
+    uint8_t count = 0;
+    uint8_t maxTg = 2;
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    while (count < maxTargets && millis() - start < budget) {
+        pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+        pn532_packetbuffer[1] = maxTg;
+        pn532_packetbuffer[2] = PN532_MIFARE_ISO14443A;
+
+        if (writeCommand(pn532_packetbuffer, 3)) {
+            break;
+        }
+
+        // Sending took part of the budget; 0 would mean no timeout at all
+        long remaining = (long)budget - (long)(millis() - start);
+        if (remaining <= 0) {
+            break;
+        }
+
+        int16_t length = readResponse(pn532_packetbuffer, _packetBufferSize, (uint16_t)remaining);
+        if (PN532_NO_SPACE == length && maxTg > 1) {
+            // Two cards with long ATS don't fit the buffer, go one by one
+            maxTg = 1;
+            continue;
+        }
+        if (length < 1 || 0 == pn532_packetbuffer[0]) {
+            break;
+        }
+
+        /* Each target: Tg, SENS_RES (2), SEL_RES, NFCIDLength, NFCID, ATS if
+           SEL_RES tells ISO14443-4.  Halting uses pn532_packetbuffer, so
+           the cards are listed first. */
+        uint8_t found = pn532_packetbuffer[0];
+        uint8_t tgs[2];
+        uint8_t halts[2];
+        uint8_t parsed = 0;
+        uint8_t news = 0;
+        uint8_t position = 1;
+
+        for (uint8_t i = 0; i < found && i < 2 && position + 5 <= length; i++) {
+            uint8_t *target = pn532_packetbuffer + position;
+            uint8_t uidLength = target[4];
+
+            position += 5 + uidLength;
+            if (position > length || uidLength > sizeof(targets[0].uid)) {
+                break;
+            }
+            if ((target[3] & PN532_SAK_ISO14443_4) && position < length) {
+                position += pn532_packetbuffer[position];
+            }
+
+            tgs[i] = target[0];
+            halts[i] = target[3] & PN532_SAK_ISO14443_4;
+            parsed++;
+
+            uint8_t known = 0;
+            for (uint8_t j = 0; j < count; j++) {
+                if (targets[j].uidLength == uidLength && 0 == memcmp(targets[j].uid, target + 5, uidLength)) {
+                    known = 1;
+                }
+            }
+            if (known || count == maxTargets) {
+                continue;
+            }
+
+            memcpy(targets[count].uid, target + 5, uidLength);
+            targets[count].uidLength = uidLength;
+            targets[count].sak = target[3];
+            targets[count].atqa = target[1] << 8 | target[2];
+            count++;
+            news++;
+        }
+
+        if (0 == news) {
+            break;
+        }
+
+        /* The PN532 already halted the first of two cards to activate the
+           second one; only ISO14443-4 cards and the active one need it */
+        for (uint8_t i = 0; i < parsed; i++) {
+            if (halts[i] || i == parsed - 1) {
+                haltTarget(tgs[i], halts[i]);
+            }
+        }
+    }
+
+    return count;
+}
+
+/**************************************************************************/
+/*!
+    Tells whether the inlisted ISO14443A target is still in the field,
+    with the cheapest check its family allows instead of a new poll:
+
+    - ISO14443-4 cards: Diagnose presence test, the PN532 sends an
+      R(NAK) and the card stays in its state
+    - Type 2 tags (SAK 0x00): READ of page 0
+    - other cards, e.g. Mifare Classic: re-selection by uid, which ends
+      any authentication
+
+    @returns 1 if the target answered, 0 if it's gone or for an error
+*/
+/**************************************************************************/
+bool PN532::isTargetPresent()
+{
+    if (_atsLen) {
+        pn532_packetbuffer[0] = PN532_COMMAND_DIAGNOSE;
+        pn532_packetbuffer[1] = PN532_DIAGNOSE_PRESENCE;
+
+        if (writeCommand(pn532_packetbuffer, 2)) {
+            return 0;
+        }
+
+        if (readResponse(pn532_packetbuffer, _packetBufferSize) < 1) {
+            return 0;
+        }
+
+        return 0 == checkStatus(pn532_packetbuffer[0]);
+    }
+
+    if (0 == _targetUidLen) {
+        return 0;
+    }
+
+    if (0x00 == _sak) {
+        uint8_t page[4];
+
+        return mifareultralight_ReadPage(0, page);
+    }
+
+    return reselectPassiveTarget(_targetUid, _targetUidLen);
+}
+
+/**************************************************************************/
+/*!
+    Changes the bit rates used with the inlisted ISO14443-4 target
+
+    @param  brIt          Bit rate from initiator to target (PN532_BR_xxx)
+    @param  brTi          Bit rate from target to initiator (PN532_BR_xxx)
+
+    @returns 1 if the target accepted the bit rates, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::inPSL(uint8_t brIt, uint8_t brTi)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INPSL;
+    pn532_packetbuffer[1] = inListedTag;
+    pn532_packetbuffer[2] = brIt;
+    pn532_packetbuffer[3] = brTi;
+
+    if (writeCommand(pn532_packetbuffer, 4)) {
+        return 0;
+    }
+
+    if (readResponse(pn532_packetbuffer, _packetBufferSize) < 1) {
+        return 0;
+    }
+
+    if (checkStatus(pn532_packetbuffer[0])) {
+        DMSG("InPSL failed, status: 0x"); DMSG_HEX(pn532_packetbuffer[0]); DMSG("\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Reads the bit rates supported by an ISO14443-4A card from TA(1) of
+    its ATS.  Without TA(1) only 106 kbps is supported.
+
+    @param  ats           The ATS, TL included
+    @param  atsLength     Length of the ATS
+    @param  brIt          Highest bit rate from PCD to card (DR)
+    @param  brTi          Highest bit rate from card to PCD (DS)
+*/
+/**************************************************************************/
+void PN532::atsBitRates(const uint8_t *ats, uint8_t atsLength, uint8_t *brIt, uint8_t *brTi)
+{
+    *brIt = PN532_BR_106;
+    *brTi = PN532_BR_106;
+
+    if (atsLength < 3 || !(ats[1] & 0x10)) {
+        return;
+    }
+
+    uint8_t ta = ats[2];
+    for (uint8_t br = PN532_BR_212; br <= PN532_BR_848; br++) {
+        if (ta & (1 << (br - 1))) {
+            *brIt = br;
+        }
+        if (ta & (0x10 << (br - 1))) {
+            *brTi = br;
+        }
+    }
+
+    // Same bit rate in both directions only
+    if (ta & 0x80) {
+        if (*brIt < *brTi) {
+            *brTi = *brIt;
+        } else {
+            *brIt = *brTi;
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    Switches the inlisted ISO14443-4A target to the highest bit rates
+    it shares with the PN532, as told by its ATS.  If the card refuses,
+    lower rates are tried; the link stays at 106 kbps if none works.
+
+    @param  maxRate       Highest bit rate to use (PN532_BR_xxx)
+
+    @returns The bit rate in use from initiator to target
+*/
+/**************************************************************************/
+uint8_t PN532::boostBitRate(uint8_t maxRate)
+{
+    uint8_t brIt;
+    uint8_t brTi;
+
+    atsBitRates(_ats, _atsLen, &brIt, &brTi);
+
+    if (brIt > maxRate) {
+        brIt = maxRate;
+    }
+    if (brTi > maxRate) {
+        brTi = maxRate;
+    }
+
+    while (brIt != PN532_BR_106 || brTi != PN532_BR_106) {
+        if (inPSL(brIt, brTi)) {
+            return brIt;
+        }
+
+        if (brIt) {
+            brIt--;
+        }
+        if (brTi) {
+            brTi--;
+        }
+    }
+
+    return PN532_BR_106;
+}
+
+/***** Mifare Classic Functions ******/
+
+/**************************************************************************/
+/*!
+      Indicates whether the specified block number is the first block
+      in the sector (block 0 relative to the current sector)
+*/
+/**************************************************************************/
+bool PN532::mifareclassic_IsFirstBlock (uint32_t uiBlock)
+{
+    // Test if we are in the small or big sectors
+    if (uiBlock < 128)
+        return ((uiBlock) % 4 == 0);
+    else
+        return ((uiBlock) % 16 == 0);
+}
+
+/**************************************************************************/
+/*!
+      Indicates whether the specified block number is the sector trailer
+*/
+/**************************************************************************/
+bool PN532::mifareclassic_IsTrailerBlock (uint32_t uiBlock)
+{
+    // Test if we are in the small or big sectors
+    if (uiBlock < 128)
+        return ((uiBlock + 1) % 4 == 0);
+    else
+        return ((uiBlock + 1) % 16 == 0);
+}
+
+/**************************************************************************/
+/*!
+      Returns the sector that holds the specified block number
+      (sectors 0..31 have 4 blocks, sectors 32..39 of 4K cards have 16)
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_BlockToSector (uint32_t uiBlock)
+{
+    if (uiBlock < 128)
+        return uiBlock / 4;
+    else
+        return 32 + (uiBlock - 128) / 16;
+}
+
+/**************************************************************************/
+/*!
+      Returns the number of the first block of the specified sector
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_SectorFirstBlock (uint8_t sectorNumber)
+{
+    if (sectorNumber < 32)
+        return sectorNumber * 4;
+    else
+        return 128 + (sectorNumber - 32) * 16;
+}
+
+/**************************************************************************/
+/*!
+      Returns the number of blocks (trailer included) in the specified sector
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_SectorBlockCount (uint8_t sectorNumber)
+{
+    return (sectorNumber < 32) ? 4 : 16;
+}
+
+/**************************************************************************/
+/*!
+      Returns the access bits group of a block: 0..2 for data blocks and
+      3 for the trailer (in 4K sectors 32..39, each group covers 5 blocks)
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_AccessGroup (uint32_t uiBlock)
+{
+    if (uiBlock < 128)
+        return uiBlock % 4;
+    else if ((uiBlock % 16) == 15)
+        return 3;
+    else
+        return (uiBlock % 16) / 5;
+}
+
+/**************************************************************************/
+/*!
+    Decodes the access bits of a sector trailer
+
+    @param  accessBits    Bytes 6..8 of the sector trailer
+    @param  conditions    Array of 4 bytes (out) receiving the access
+                          condition C1C2C3 (C1 = bit 2) of each group,
+                          group 3 being the trailer
+
+    @returns 1 if the access bits are consistent, 0 if the inverted
+             copies do not match (the card would block such a sector)
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ParseAccessBits (const uint8_t *accessBits, uint8_t *conditions)
+{
+    uint8_t c1 = accessBits[1] >> 4;
+    uint8_t c2 = accessBits[2] & 0x0F;
+    uint8_t c3 = accessBits[2] >> 4;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        conditions[i] = (((c1 >> i) & 1) << 2) | (((c2 >> i) & 1) << 1) | ((c3 >> i) & 1);
+    }
+
+    return ((uint8_t)(~c1 & 0x0F) == (accessBits[0] & 0x0F)) &&
+           ((uint8_t)(~c2 & 0x0F) == (accessBits[0] >> 4)) &&
+           ((uint8_t)(~c3 & 0x0F) == (accessBits[1] & 0x0F));
+}
+
+/**************************************************************************/
+/*!
+    Encodes access conditions into the access bits of a sector trailer
+
+    @param  conditions    Access condition C1C2C3 of the 4 groups
+    @param  accessBits    Bytes 6..8 of the sector trailer (out), byte 9
+                          (general purpose byte) is left to the caller
+*/
+/**************************************************************************/
+void PN532::mifareclassic_BuildAccessBits (const uint8_t *conditions, uint8_t *accessBits)
+{
+    uint8_t c1 = 0, c2 = 0, c3 = 0;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        c1 |= ((conditions[i] >> 2) & 1) << i;
+        c2 |= ((conditions[i] >> 1) & 1) << i;
+        c3 |= (conditions[i] & 1) << i;
+    }
+
+    accessBits[0] = ((~c2 & 0x0F) << 4) | (~c1 & 0x0F);
+    accessBits[1] = (c1 << 4) | (~c3 & 0x0F);
+    accessBits[2] = (c3 << 4) | c2;
+}
+
+/**************************************************************************/
+/*!
+    Computes which key may read, write, increment and decrement the
+    blocks of a group (see MIFARE_ACCESS_*).  When key B is readable
+    (trailer conditions 000, 010 and 001) it can not be used to
+    authenticate, so no permission is granted to key B on data blocks.
+
+    @param  conditions    Access conditions of the sector, as returned by
+                          mifareclassic_ParseAccessBits
+    @param  group         0..2 for data blocks, 3 for the trailer
+
+    @returns the permission bits
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_AccessPermissions (const uint8_t *conditions, uint8_t group)
+{
+    // indexed by C1C2C3
+    static const uint8_t dataPermissions[8] = {
+        0xFF,                                                   // 000
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B |
+        MIFARE_ACCESS_DECREMENT_A | MIFARE_ACCESS_DECREMENT_B,  // 001
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B,            // 010
+        MIFARE_ACCESS_READ_B | MIFARE_ACCESS_WRITE_B,           // 011
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B |
+        MIFARE_ACCESS_WRITE_B,                                  // 100
+        MIFARE_ACCESS_READ_B,                                   // 101
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B |
+        MIFARE_ACCESS_WRITE_B | MIFARE_ACCESS_INCREMENT_B |
+        MIFARE_ACCESS_DECREMENT_A | MIFARE_ACCESS_DECREMENT_B,  // 110
+        0x00                                                    // 111
+    };
+    // read / write of the access bits (and of the keys along with them)
+    static const uint8_t trailerPermissions[8] = {
+        MIFARE_ACCESS_READ_A,                                   // 000
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_WRITE_A,           // 001
+        MIFARE_ACCESS_READ_A,                                   // 010
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B |
+        MIFARE_ACCESS_WRITE_B,                                  // 011
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B,            // 100
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B |
+        MIFARE_ACCESS_WRITE_B,                                  // 101
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B,            // 110
+        MIFARE_ACCESS_READ_A | MIFARE_ACCESS_READ_B             // 111
+    };
+
+    uint8_t trailer = conditions[3] & 0x07;
+
+    if (3 == group) {
+        return trailerPermissions[trailer];
+    }
+
+    uint8_t permissions = dataPermissions[conditions[group] & 0x07];
+    if ((0x0 == trailer) || (0x2 == trailer) || (0x1 == trailer)) {
+        permissions &= 0x55;    // key B is readable, keep key A bits only
+    }
+
+    return permissions;
+}
+
+/**************************************************************************/
+/*!
+    Picks the key to use for an operation
+
+    @param  permissions   Permission bits of the block
+    @param  operation     MIFARE_ACCESS_OP_READ, _WRITE, _INCREMENT or
+                          _DECREMENT
+    @param  preferredKey  Key type to return when both keys are allowed
+                          (usually the one the sector is authenticated with)
+
+    @returns 0 for key A, 1 for key B, MIFARE_CLASSIC_NO_KEY if the
+             operation is not allowed
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_KeyForOperation (uint8_t permissions, uint8_t operation, uint8_t preferredKey)
+{
+    uint8_t other = preferredKey ? 0 : 1;
+
+    if (permissions & (1 << (2 * operation + (preferredKey ? 1 : 0))))
+        return preferredKey ? 1 : 0;
+    if (permissions & (1 << (2 * operation + other)))
+        return other;
+
+    return MIFARE_CLASSIC_NO_KEY;
+}
+
+/**************************************************************************/
+/*!
+    Tries to authenticate a block of memory on a MIFARE card using the
+    INDATAEXCHANGE command.  See section 7.3.8 of the PN532 User Manual
+    for more information on sending MIFARE and other commands.
+
+    @param  uid           Pointer to a byte array containing the card UID
+    @param  uidLen        The length (in bytes) of the card's UID (Should
+                          be 4 for MIFARE Classic)
+    @param  blockNumber   The block number to authenticate.  (0..63 for
+                          1KB cards, and 0..255 for 4KB cards).
+    @param  keyNumber     Which key type to use during authentication
+                          (0 = MIFARE_CMD_AUTH_A, 1 = MIFARE_CMD_AUTH_B)
+    @param  keyData       Pointer to a byte array containing the 6 bytes
+                          key value
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_AuthenticateBlock (const uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, const uint8_t *keyData)
+{
+    uint8_t i;
+
+    if (uidLen > sizeof(_uid)) {
+        DMSG("UID too long\n");
+        _authSector = MIFARE_CLASSIC_NO_SECTOR;
+        return 0;
+    }
+
+    // Hang on to the key and uid data
+    memcpy (_key, keyData, 6);
+    memcpy (_uid, uid, uidLen);
+    _uidLen = uidLen;
+
+    // Prepare the authentication command //
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;   /* Data Exchange Header */
+    pn532_packetbuffer[1] = 1;                              /* Max card numbers */
+    pn532_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
+    pn532_packetbuffer[3] = blockNumber;                    /* Block Number (1K = 0..63, 4K = 0..255 */
+    memcpy (pn532_packetbuffer + 4, _key, 6);
+    for (i = 0; i < _uidLen; i++) {
+        pn532_packetbuffer[10 + i] = _uid[i];              /* 4 bytes card ID */
+    }
+
+    if (writeCommand(pn532_packetbuffer, 10 + _uidLen))
+        return 0;
+
+    // Read the response packet
+    // Check if the response is valid and we are authenticated???
+    // for an auth success it should be bytes 5-7: 0xD5 0x41 0x00
+    // Mifare auth error is technically byte 7: 0x14 but anything other and 0x00 is not good
+    if (readResponse(pn532_packetbuffer, _packetBufferSize) < 1 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG("Authentification failed\n");
+        _authSector = MIFARE_CLASSIC_NO_SECTOR;
+        return 0;
+    }
+
+    // Remember what we are authenticated for, see mifareclassic_AuthenticateSector
+    _authSector = mifareclassic_BlockToSector(blockNumber);
+    _authKeyNumber = keyNumber ? 1 : 0;
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Authenticates a whole sector, unless the card is already authenticated
+    for that sector with the same uid, key type and key.  In that case no
+    command is sent to the card at all.
+
+    @param  uid           Pointer to a byte array containing the card UID
+    @param  uidLen        The length (in bytes) of the card's UID
+    @param  sectorNumber  The sector to authenticate (0..15 for 1KB cards,
+                          and 0..39 for 4KB cards)
+    @param  keyNumber     Which key type to use during authentication
+                          (0 = MIFARE_CMD_AUTH_A, 1 = MIFARE_CMD_AUTH_B)
+    @param  keyData       Pointer to a byte array containing the 6 bytes
+                          key value
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_AuthenticateSector (const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t keyNumber, const uint8_t *keyData)
+{
+    if ((_authSector == sectorNumber) &&
+            (_authKeyNumber == (keyNumber ? 1 : 0)) &&
+            (_uidLen == uidLen) &&
+            (0 == memcmp(_uid, uid, uidLen)) &&
+            (0 == memcmp(_key, keyData, 6))) {
+        return 1;
+    }
+
+    return mifareclassic_AuthenticateBlock(uid, uidLen, mifareclassic_SectorFirstBlock(sectorNumber), keyNumber, keyData);
+}
+
+/**************************************************************************/
+/*!
+    Tries to read an entire 16-bytes data block at the specified block
+    address.
+
+    @param  blockNumber   The block number to authenticate.  (0..63 for
+                          1KB cards, and 0..255 for 4KB cards).
+    @param  data          Pointer to the byte array that will hold the
+                          retrieved data (if any)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ReadDataBlock (uint8_t blockNumber, uint8_t *data)
+{
+    DMSG("Trying to read 16 bytes from block ");
+    DMSG_INT(blockNumber);
+
+    /* Prepare the command */
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;                      /* Card number */
+    pn532_packetbuffer[2] = MIFARE_CMD_READ;        /* Mifare Read command = 0x30 */
+    pn532_packetbuffer[3] = blockNumber;            /* Block Number (0..63 for 1K, 0..255 for 4K) */
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 4)) {
+        return 0;
+    }
+
+    /* Read the response packet */
+    /* If byte 8 isn't 0x00 we probably have an error */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 1 || checkStatus(pn532_packetbuffer[0]) || status < 17) {
+        /* The card drops its authentication after an error */
+        _authSector = MIFARE_CLASSIC_NO_SECTOR;
+        return 0;
+    }
+
+    /* Copy the 16 data bytes to the output buffer        */
+    /* Block content starts at byte 9 of a valid response */
+    memcpy (data, pn532_packetbuffer + 1, 16);
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Reads all the blocks of a sector, trailer included, authenticating
+    the sector only once (and not at all if it is already authenticated
+    with the same key).
+
+    @param  uid           Pointer to a byte array containing the card UID
+    @param  uidLen        The length (in bytes) of the card's UID
+    @param  sectorNumber  The sector to read (0..15 for 1KB cards, and
+                          0..39 for 4KB cards)
+    @param  keyNumber     Which key type to use during authentication
+                          (0 = MIFARE_CMD_AUTH_A, 1 = MIFARE_CMD_AUTH_B)
+    @param  keyData       Pointer to a byte array containing the 6 bytes
+                          key value
+    @param  data          Pointer to the byte array that will hold the
+                          sector image (64 bytes, or 256 bytes for
+                          sectors 32..39 of 4KB cards)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ReadSector (const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t keyNumber, const uint8_t *keyData, uint8_t *data)
+{
+    if (!mifareclassic_AuthenticateSector(uid, uidLen, sectorNumber, keyNumber, keyData)) {
+        return 0;
+    }
+
+    uint8_t firstBlock = mifareclassic_SectorFirstBlock(sectorNumber);
+    uint8_t blockCount = mifareclassic_SectorBlockCount(sectorNumber);
+
+    for (uint8_t i = 0; i < blockCount; i++) {
+        if (!mifareclassic_ReadDataBlock(firstBlock + i, data + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+            DMSG("Failed to read block ");
+            DMSG_INT(firstBlock + i);
+            DMSG("\n");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Tries to write an entire 16-bytes data block at the specified block
+    address.
+
+    @param  blockNumber   The block number to authenticate.  (0..63 for
+                          1KB cards, and 0..255 for 4KB cards).
+    @param  data          The byte array that contains the data to write.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_WriteDataBlock (uint8_t blockNumber, uint8_t *data)
+{
+    /* Prepare the first command */
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;                      /* Card number */
+    pn532_packetbuffer[2] = MIFARE_CMD_WRITE;       /* Mifare Write command = 0xA0 */
+    pn532_packetbuffer[3] = blockNumber;            /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    memcpy (pn532_packetbuffer + 4, data, 16);        /* Data Payload */
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 20)) {
+        return 0;
+    }
+
+    /* Read the response packet */
+    if (readResponse(pn532_packetbuffer, _packetBufferSize) < 1) {
+        return 0;
+    }
+
+    /* The card drops its authentication after an error */
+    if (checkStatus(pn532_packetbuffer[0])) {
+        _authSector = MIFARE_CLASSIC_NO_SECTOR;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Writes a value block: the value three times (once inverted) and the
+    address byte four times (twice inverted), as required by the
+    INCREMENT, DECREMENT, RESTORE and TRANSFER commands.
+
+    @param  blockNumber   The block to format (must not be a trailer)
+    @param  value         The initial value
+    @param  address       Address byte, free for the application (usually
+                          the block number, for backup management)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_FormatValueBlock (uint8_t blockNumber, int32_t value, uint8_t address)
+{
+    uint8_t block[16];
+
+    if (mifareclassic_IsTrailerBlock(blockNumber)) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t b = (uint32_t)value >> (8 * i);
+        block[i] = b;
+        block[4 + i] = ~b;
+        block[8 + i] = b;
+    }
+    block[12] = address;
+    block[13] = ~address;
+    block[14] = address;
+    block[15] = ~address;
+
+    return mifareclassic_WriteDataBlock(blockNumber, block);
+}
+
+/**************************************************************************/
+/*!
+    Reads a value block and checks its redundant encoding
+
+    @param  blockNumber   The block to read
+    @param  value         Pointer to the value (out)
+    @param  address       Pointer to the address byte (out), may be 0
+
+    @returns 1 if everything executed properly, 0 for an error or if the
+             block is not a valid value block
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ReadValueBlock (uint8_t blockNumber, int32_t *value, uint8_t *address)
+{
+    uint8_t block[16];
+
+    if (!mifareclassic_ReadDataBlock(blockNumber, block)) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        if ((block[i] != block[8 + i]) || (block[i] != (uint8_t)~block[4 + i])) {
+            DMSG("Not a value block\n");
+            return 0;
+        }
+    }
+    if ((block[12] != block[14]) || (block[13] != block[15]) || (block[12] != (uint8_t)~block[13])) {
+        DMSG("Not a value block\n");
+        return 0;
+    }
+
+    *value = (int32_t)((uint32_t)block[0] | ((uint32_t)block[1] << 8) |
+                       ((uint32_t)block[2] << 16) | ((uint32_t)block[3] << 24));
+    if (address) {
+        *address = block[12];
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Sends an INCREMENT, DECREMENT, RESTORE or TRANSFER command.  The PN532
+    handles the two parts of the first three commands in one exchange.
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ValueCommand (uint8_t command, uint8_t blockNumber, uint32_t operand)
+{
+    uint8_t len = 4;
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;                      /* Card number */
+    pn532_packetbuffer[2] = command;
+    pn532_packetbuffer[3] = blockNumber;
+    if (MIFARE_CMD_TRANSFER != command) {
+        for (uint8_t i = 0; i < 4; i++) {
+            pn532_packetbuffer[4 + i] = operand >> (8 * i);
+        }
+        len += 4;
+    }
+
+    if (writeCommand(pn532_packetbuffer, len)) {
+        return 0;
+    }
+
+    if (readResponse(pn532_packetbuffer, _packetBufferSize) < 1) {
+        return 0;
+    }
+
+    if (checkStatus(pn532_packetbuffer[0])) {
+        DMSG("Value operation failed\n");
+        _authSector = MIFARE_CLASSIC_NO_SECTOR;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Adds delta to a value block and keeps the result in the card's
+    transfer buffer; use mifareclassic_TransferValueBlock to store it
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_IncrementValueBlock (uint8_t blockNumber, uint32_t delta)
+{
+    return mifareclassic_ValueCommand(MIFARE_CMD_INCREMENT, blockNumber, delta);
+}
+
+/**************************************************************************/
+/*!
+    Subtracts delta from a value block and keeps the result in the card's
+    transfer buffer; use mifareclassic_TransferValueBlock to store it
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_DecrementValueBlock (uint8_t blockNumber, uint32_t delta)
+{
+    return mifareclassic_ValueCommand(MIFARE_CMD_DECREMENT, blockNumber, delta);
+}
+
+/**************************************************************************/
+/*!
+    Copies a value block into the card's transfer buffer (e.g. to back it
+    up into another block with mifareclassic_TransferValueBlock)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_RestoreValueBlock (uint8_t blockNumber)
+{
+    return mifareclassic_ValueCommand(MIFARE_CMD_STORE, blockNumber, 0);
+}
+
+/**************************************************************************/
+/*!
+    Writes the card's transfer buffer into a value block
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_TransferValueBlock (uint8_t blockNumber)
+{
+    return mifareclassic_ValueCommand(MIFARE_CMD_TRANSFER, blockNumber, 0);
+}
+
+/**************************************************************************/
+/*!
+    Runs a list of value block operations on the sector currently
+    authenticated.  Each operation costs two exchanges (operation and
+    TRANSFER), with no read-modify-write on the host.  All the blocks are
+    checked against the authenticated sector before anything is sent.
+
+    @param  ops     Operations to run, in order
+    @param  count   Number of operations
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_ValueBatch (const mifareclassic_ValueOp *ops, uint8_t count)
+{
+    if (MIFARE_CLASSIC_NO_SECTOR == _authSector) {
+        DMSG("No sector authenticated\n");
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        if ((mifareclassic_BlockToSector(ops[i].block) != _authSector) ||
+                (mifareclassic_BlockToSector(ops[i].transferBlock) != _authSector) ||
+                mifareclassic_IsTrailerBlock(ops[i].block) ||
+                mifareclassic_IsTrailerBlock(ops[i].transferBlock)) {
+            DMSG("Value operation outside of the authenticated sector\n");
+            return 0;
+        }
+        if ((MIFARE_CMD_INCREMENT != ops[i].command) &&
+                (MIFARE_CMD_DECREMENT != ops[i].command) &&
+                (MIFARE_CMD_STORE != ops[i].command)) {
+            return 0;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (!mifareclassic_ValueCommand(ops[i].command, ops[i].block, ops[i].operand)) {
+            return 0;
+        }
+        if (!mifareclassic_ValueCommand(MIFARE_CMD_TRANSFER, ops[i].transferBlock, 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Formats a Mifare Classic card to store NDEF Records
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_FormatNDEF (void)
+{
+    uint8_t sectorbuffer1[16] = {0x14, 0x01, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
+    uint8_t sectorbuffer2[16] = {0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
+    uint8_t sectorbuffer3[16] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0x78, 0x77, 0x88, 0xC1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    // Note 0xA0 0xA1 0xA2 0xA3 0xA4 0xA5 must be used for key A
     // for the MAD sector in NDEF records (sector 0)
 
-    // Write block 1 and 2 to the card
-    if (!(mifareclassic_WriteDataBlock (1, sectorbuffer1)))
+    // Write block 1 and 2 to the card
+    if (!(mifareclassic_WriteDataBlock (1, sectorbuffer1)))
+        return 0;
+    if (!(mifareclassic_WriteDataBlock (2, sectorbuffer2)))
+        return 0;
+    // Write key A and access rights card
+    if (!(mifareclassic_WriteDataBlock (3, sectorbuffer3)))
+        return 0;
+
+    // Seems that everything was OK (?!)
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Writes an NDEF URI Record to the specified sector (1..15)
+
+    Note that this function assumes that the Mifare Classic card is
+    already formatted to work as an "NFC Forum Tag" and uses a MAD1
+    file system.  You can use the NXP TagWriter app on Android to
+    properly format cards for this.
+
+    @param  sectorNumber  The sector that the URI record should be written
+                          to (can be 1..15 for a 1K card)
+    @param  uriIdentifier The uri identifier code (0 = none, 0x01 =
+                          "http://www.", etc.)
+    @param  url           The uri text to write (max 38 characters).
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareclassic_WriteNDEFURI (uint8_t sectorNumber, uint8_t uriIdentifier, const char *url)
+{
+    // Figure out how long the string is
+    uint8_t len = strlen(url);
+
+    // Make sure we're within a 1K limit for the sector number
+    if ((sectorNumber < 1) || (sectorNumber > 15))
+        return 0;
+
+    // Make sure the URI payload is between 1 and 38 chars
+    if ((len < 1) || (len > 38))
+        return 0;
+
+    // Note 0xD3 0xF7 0xD3 0xF7 0xD3 0xF7 must be used for key A
+    // in NDEF records
+
+    // Setup the sector buffer (w/pre-formatted TLV wrapper and NDEF message)
+    uint8_t sectorbuffer1[16] = {0x00, 0x00, 0x03, len + 5, 0xD1, 0x01, len + 1, 0x55, uriIdentifier, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t sectorbuffer2[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t sectorbuffer3[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t sectorbuffer4[16] = {0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7, 0x7F, 0x07, 0x88, 0x40, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (len <= 6) {
+        // Unlikely we'll get a url this short, but why not ...
+        memcpy (sectorbuffer1 + 9, url, len);
+        sectorbuffer1[len + 9] = 0xFE;
+    } else if (len == 7) {
+        // 0xFE needs to be wrapped around to next block
+        memcpy (sectorbuffer1 + 9, url, len);
+        sectorbuffer2[0] = 0xFE;
+    } else if ((len > 7) || (len <= 22)) {
+        // Url fits in two blocks
+        memcpy (sectorbuffer1 + 9, url, 7);
+        memcpy (sectorbuffer2, url + 7, len - 7);
+        sectorbuffer2[len - 7] = 0xFE;
+    } else if (len == 23) {
+        // 0xFE needs to be wrapped around to final block
+        memcpy (sectorbuffer1 + 9, url, 7);
+        memcpy (sectorbuffer2, url + 7, len - 7);
+        sectorbuffer3[0] = 0xFE;
+    } else {
+        // Url fits in three blocks
+        memcpy (sectorbuffer1 + 9, url, 7);
+        memcpy (sectorbuffer2, url + 7, 16);
+        memcpy (sectorbuffer3, url + 23, len - 24);
+        sectorbuffer3[len - 22] = 0xFE;
+    }
+
+    // Now write all three blocks back to the card
+    if (!(mifareclassic_WriteDataBlock (sectorNumber * 4, sectorbuffer1)))
+        return 0;
+    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 1, sectorbuffer2)))
+        return 0;
+    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 2, sectorbuffer3)))
+        return 0;
+    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 3, sectorbuffer4)))
+        return 0;
+
+    // Seems that everything was OK (?!)
+    return 1;
+}
+
+/***** Mifare Ultralight Functions ******/
+
+/**************************************************************************/
+/*!
+    Tries to read an entire 4-bytes page at the specified address.
+
+    @param  page        The page number (0..63 in most cases)
+    @param  buffer      Pointer to the byte array that will hold the
+                        retrieved data (if any)
+*/
+/**************************************************************************/
+uint8_t PN532::mifareultralight_ReadPage (uint8_t page, uint8_t *buffer)
+{
+    if (page >= 64) {
+        DMSG("Page value out of range\n");
+        return 0;
+    }
+
+    /* Prepare the command */
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;                   /* Card number */
+    pn532_packetbuffer[2] = MIFARE_CMD_READ;     /* Mifare Read command = 0x30 */
+    pn532_packetbuffer[3] = page;                /* Page Number (0..63 in most cases) */
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 4)) {
+        return 0;
+    }
+
+    /* Read the response packet */
+    /* If byte 8 isn't 0x00 we probably have an error */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status >= 1 && 0 == checkStatus(pn532_packetbuffer[0]) && status >= 5) {
+        /* Copy the 4 data bytes to the output buffer         */
+        /* Block content starts at byte 9 of a valid response */
+        /* Note that the command actually reads 16 bytes or 4  */
+        /* pages at a time ... we simply discard the last 12  */
+        /* bytes                                              */
+        memcpy (buffer, pn532_packetbuffer + 1, 4);
+    } else {
+        return 0;
+    }
+
+    // Return OK signal
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Tries to write an entire 4-bytes data buffer at the specified page
+    address.
+
+    @param  page     The page number to write into.  (0..63).
+    @param  buffer   The byte array that contains the data to write.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::mifareultralight_WritePage (uint8_t page, uint8_t *buffer)
+{
+    /* Prepare the first command */
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;                           /* Card number */
+    pn532_packetbuffer[2] = MIFARE_CMD_WRITE_ULTRALIGHT; /* Mifare UL Write cmd = 0xA2 */
+    pn532_packetbuffer[3] = page;                        /* page Number (0..63) */
+    memcpy (pn532_packetbuffer + 4, buffer, 4);          /* Data Payload */
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 8)) {
+        return 0;
+    }
+
+    /* Read the response packet */
+    if (0 >= readResponse(pn532_packetbuffer, _packetBufferSize)) {
+        return 0;
+    }
+
+    return 0 == checkStatus(pn532_packetbuffer[0]);
+}
+
+
+/***** NFC Forum Type 4 Tag Functions ******/
+
+/**************************************************************************/
+/*!
+    Selects NDEF application on target
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_select_ndef_application () {
+    uint8_t c_apdu[] = {
+        0x00, 0xA4, 0x04, 0x00, 0x07,
+        0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00
+    };
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
+        DMSG_STR("Error in writing command (select ndef application)");
+        return 0;
+    }
+
+    /* Read the response packet */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 3 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (select ndef application)");
+        return 0;
+    }
+
+    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
+        DMSG_STR("Error in ndef application selection");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Selects capability container file on target
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_select_cc () {
+    uint8_t c_apdu[] = {
+        0x00, 0xA4, 0x00, 0x0C, 0x02, 0xE1, 0x03
+    };
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
+        DMSG_STR("Error in writing command (select cc)");
+        return 0;
+    }
+
+    /* Read the response packet */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 3 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (select cc)");
+        return 0;
+    }
+
+    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
+        DMSG_STR("Error in cc file selection");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Selects NDEF file on target
+
+    @param  file_id     ID of the ndef file given in CC
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_select_ndef (uint16_t file_id) {
+    uint8_t c_apdu[] = {
+        0x00, 0xA4, 0x00, 0x0C, 0x02, file_id >> 8, file_id & 0xFF
+    };
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
+        DMSG_STR("Error in writing command (select ndef)");
+        return 0;
+    }
+
+    /* Read the response packet */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 3 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (select ndef)");
+        return 0;
+    }
+
+    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
+        DMSG_STR("Error in ndef file selection");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Reads CC file after having selected it
+
+    @param  length      Actual length of CC file (out)
+    @param  buffer      Pointer to the byte array that will hold the
+                        retrieved data (if any)
+    @param  size        Size of buffer, at least TYPE4_CC_SIZE
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_read_cc (uint16_t *length, uint8_t *buffer, uint8_t size) {
+    uint8_t c_apdu[] = {
+        0x00, 0xB0, 0x00, 0x00, TYPE4_CC_SIZE
+    };
+
+    if (size < TYPE4_CC_SIZE) {
+        return 0;
+    }
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
+        DMSG_STR("Error in writing command (read cc)");
+        return 0;
+    }
+
+    /* Read the response packet */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 3 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (read cc)");
+        return 0;
+    }
+
+    /* The SW follows the data actually received, whatever CCLEN says */
+    uint8_t received = status - 3;
+    if (pn532_packetbuffer[received + 1] != 0x90 || pn532_packetbuffer[received + 2] != 0x00) {
+        DMSG_STR("Error in cc reading");
+        return 0;
+    }
+
+    if (received < TYPE4_CC_SIZE) {
+        DMSG_STR("CC too short");
+        return 0;
+    }
+
+    *length = (received < size) ? received : size;
+    memcpy (buffer, pn532_packetbuffer + 1, *length);
+
+    // Later READ BINARY / UPDATE BINARY commands must not exceed MLe / MLc
+    _type4Mle = buffer[3] << 8 | buffer[4];
+    _type4Mlc = buffer[5] << 8 | buffer[6];
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Decodes a Capability Container
+
+    @param  cc          The CC file, as read by type4_read_cc
+    @param  params      Decoded CC (out)
+
+    @returns 1 if the CC holds an NDEF File Control TLV, 0 otherwise
+*/
+/**************************************************************************/
+uint8_t PN532::type4_parse_cc (const uint8_t *cc, type4_cc_t *params)
+{
+    params->mle = cc[3] << 8 | cc[4];
+    params->mlc = cc[5] << 8 | cc[6];
+
+    if (cc[7] != 0x04 || cc[8] < 0x06) {
+        DMSG_STR("No NDEF File Control TLV");
+        return 0;
+    }
+
+    params->fileId = cc[9] << 8 | cc[10];
+    params->maxNdefSize = cc[11] << 8 | cc[12];
+    params->readAccess = cc[13];
+    params->writeAccess = cc[14];
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Largest READ BINARY response data that fits both the MLe of the tag
+    and pn532_packetbuffer (status byte and SW1 SW2 included)
+*/
+/**************************************************************************/
+uint8_t PN532::type4_chunk_size ()
+{
+    uint8_t size = _packetBufferSize - 3;
+
+    if (_type4Mle && _type4Mle < size) {
+        size = _type4Mle;
+    }
+
+    return size;
+}
+
+/**************************************************************************/
+/*!
+    Largest UPDATE BINARY command data that fits both the MLc of the tag
+    and pn532_packetbuffer (command, target and APDU header included)
+*/
+/**************************************************************************/
+uint8_t PN532::type4_update_chunk_size ()
+{
+    uint8_t size = _packetBufferSize - 7;
+
+    if (_type4Mlc && _type4Mlc < size) {
+        size = _type4Mlc;
+    }
+
+    return size;
+}
+
+/**************************************************************************/
+/*!
+    Reads part of the currently selected file with READ BINARY
+
+    @param  offset      Offset in the file (0..0x7FFF)
+    @param  le          Number of bytes to read, at most MLe and the size
+                        of the packet buffer minus 3
+    @param  buffer      Pointer to the byte array that will hold the
+                        retrieved data
+
+    @returns the number of bytes read (may be less than le at the end of
+             the file), -1 for an error
+*/
+/**************************************************************************/
+int16_t PN532::type4_read_binary (uint16_t offset, uint8_t le, uint8_t *buffer)
+{
+    if (le > _packetBufferSize - 3) {
+        return -1;
+    }
+
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    pn532_packetbuffer[2] = 0x00;
+    pn532_packetbuffer[3] = 0xB0;
+    pn532_packetbuffer[4] = (offset >> 8) & 0x7F;
+    pn532_packetbuffer[5] = offset & 0xFF;
+    pn532_packetbuffer[6] = le;
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 7)) {
+        DMSG_STR("Error in writing command (read binary)");
+        return -1;
+    }
+
+    /* Read the response packet */
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 3 || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (read binary)");
+        return -1;
+    }
+
+    uint8_t length = status - 3;
+    if (pn532_packetbuffer[length + 1] != 0x90 || pn532_packetbuffer[length + 2] != 0x00) {
+        DMSG_STR("Error in binary reading");
+        return -1;
+    }
+
+    if (length > le) {
+        DMSG_STR("More data than requested (read binary)");
+        return -1;
+    }
+
+    memmove (buffer, pn532_packetbuffer + 1, length);   /* buffer may be pn532_packetbuffer + 1 */
+
+    return length;
+}
+
+/**************************************************************************/
+/*!
+    Reads NDEF file after having selected it
+
+    @param  length      Actual length of NDEF file (out)
+    @param  buffer      Pointer to the byte array that will hold the
+                        retrieved data (if any)
+    @param  size        Size of buffer
+
+    @returns 1 if everything executed properly, 0 for an error or if the
+             file does not fit in buffer
+*/
+/**************************************************************************/
+uint8_t PN532::type4_read_ndef (uint16_t *length, uint8_t *buffer, uint16_t size) {
+    uint8_t nlen[2];
+
+    /* Read file length */
+    if (2 != type4_read_binary(0, 2, nlen)) {
+        DMSG_STR("Error while reading data (read ndef length)");
+        return 0;
+    }
+
+    *length = nlen[0] << 8 | nlen[1];
+    if (*length > size) {
+        DMSG_STR("NDEF file larger than the buffer");
+        return 0;
+    }
+
+    /* Read file, in chunks the tag and pn532_packetbuffer can hold */
+    uint8_t chunk = type4_chunk_size();
+    for (uint16_t offset = 0; offset < *length; ) {
+        uint8_t le = (*length - offset < chunk) ? *length - offset : chunk;
+        int16_t status = type4_read_binary(2 + offset, le, buffer + offset);
+        if (status <= 0) {
+            DMSG_STR("Error while reading data (read ndef)");
+            return 0;
+        }
+        offset += status;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Writes part of the currently selected file with UPDATE BINARY
+
+    @param  offset      Offset in the file (0..0x7FFF)
+    @param  data        The bytes to write (may already be at
+                        pn532_packetbuffer + 7)
+    @param  lc          Number of bytes to write, at most MLc and the size
+                        of the packet buffer minus 7
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_update_binary (uint16_t offset, const uint8_t *data, uint8_t lc)
+{
+    if (lc > _packetBufferSize - 7) {
+        return 0;
+    }
+
+    memmove(pn532_packetbuffer + 7, data, lc);
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = 1;
+    pn532_packetbuffer[2] = 0x00;
+    pn532_packetbuffer[3] = 0xD6;
+    pn532_packetbuffer[4] = (offset >> 8) & 0x7F;
+    pn532_packetbuffer[5] = offset & 0xFF;
+    pn532_packetbuffer[6] = lc;
+
+    /* Send the command */
+    if (writeCommand(pn532_packetbuffer, 7 + lc)) {
+        DMSG_STR("Error in writing command (update binary)");
+        return 0;
+    }
+
+    /* Read the response packet */
+    if (3 > readResponse(pn532_packetbuffer, _packetBufferSize) || checkStatus(pn532_packetbuffer[0])) {
+        DMSG_STR("Error while reading data (update binary)");
+        return 0;
+    }
+
+    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
+        DMSG_STR("Error in binary writing");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Writes an NDEF message into the selected NDEF file, following the
+    NFC Forum procedure: NLEN is set to 0 along with the first chunk,
+    the message goes in chunks as large as MLc and pn532_packetbuffer
+    allow, and NLEN is written last.  A tag removed during the write is
+    left with an empty message rather than a corrupt one.
+
+    The message comes from source, or from data if source is 0.
+*/
+/**************************************************************************/
+uint8_t PN532::type4_write_ndef_stream (ndefSource source, const uint8_t *data, uint16_t length)
+{
+    uint8_t chunk = type4_update_chunk_size();
+    uint8_t *payload = pn532_packetbuffer + 7;
+    uint16_t offset = 0;
+
+    while (offset < length + 2) {
+        uint8_t lc = (length + 2 - offset < chunk) ? length + 2 - offset : chunk;
+        uint8_t head = 0;
+
+        // NLEN, committed at the end.  MLc may be 1, so it can take a
+        // chunk of its own
+        if (offset < 2) {
+            head = (2 - offset < lc) ? 2 - offset : lc;
+            memset(payload, 0x00, head);
+        }
+
+        if (lc == head) {
+            // nothing of the message in this chunk
+        } else if (source) {
+            if (source(payload + head, offset + head - 2, lc - head) != lc - head) {
+                DMSG_STR("NDEF source ended early");
+                return 0;
+            }
+        } else {
+            memcpy(payload + head, data + offset + head - 2, lc - head);
+        }
+
+        if (!type4_update_binary(offset, payload, lc)) {
+            return 0;
+        }
+        offset += lc;
+    }
+
+    payload[0] = length >> 8;
+    payload[1] = length & 0xFF;
+
+    if (chunk < 2) {
+        return type4_update_binary(0, payload, 1) && type4_update_binary(1, payload + 1, 1);
+    }
+
+    return type4_update_binary(0, payload, 2);
+}
+
+/**************************************************************************/
+/*!
+    Tries to write NDEF file to the target after having selected it
+
+    @param  length     Length of data to write
+    @param  data       The byte array that contains the data to write.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_write_ndef (uint8_t length, uint8_t *data) {
+    return type4_write_ndef_stream(0, data, length);
+}
+
+/**************************************************************************/
+/*!
+    Tries to read the NDEF data (according to 5.4.6 in spec)
+
+    @param  length      Actual length of retrieved data
+    @param  buffer      Pointer to the byte array that will hold the
+                        retrieved data (if any)
+    @param  size        Size of buffer, at least TYPE4_CC_SIZE
+
+    @returns 1 if everything executed properly, 0 for an error or if the
+             data does not fit in buffer
+*/
+/**************************************************************************/
+uint8_t PN532::type4_ReadFile (uint16_t *length, uint8_t *buffer, uint16_t size)
+{
+    uint16_t buf_length;
+
+    if (size < TYPE4_CC_SIZE) {
+        DMSG_STR("Buffer too small for the CC");
         return 0;
-    if (!(mifareclassic_WriteDataBlock (2, sectorbuffer2)))
+    }
+
+    if (!type4_select_ndef_application()) {
         return 0;
-    // Write key A and access rights card
-    if (!(mifareclassic_WriteDataBlock (3, sectorbuffer3)))
+    }
+
+    if (!type4_select_cc()) {
         return 0;
+    }
+
+    if (!type4_read_cc(&buf_length, buffer, TYPE4_CC_SIZE)) {
+        return 0;
+    }
+
+    /* Check mapping version */
+    if (buffer[2] >> 4 == TYPE4_MAPPING_MAJOR) {
+        if (buffer[2] & 0x0F > TYPE4_MAPPING_MINOR) {
+            DMSG_STR("WARNING : Mapping minor version outdated, Tag may have additionnal features not implemented on this device");
+        }
+    } else {
+        DMSG_STR("Mapping version not implemented");
+        return 0;
+    }
+
+    if (buffer[13] != 0x00) {
+        DMSG_STR("File isn't readable");
+        return 0;
+    }
+
+    uint16_t file_id = buffer[9] << 8 | buffer[10];
+
+    if (!type4_select_ndef(file_id)) {
+        return 0;
+    }
+
+    if (!type4_read_ndef(&buf_length, buffer, size)) {
+        return 0;
+    }
+
+    *length = buf_length;
 
-    // Seems that everything was OK (?!)
     return 1;
 }
 
 /**************************************************************************/
 /*!
-    Writes an NDEF URI Record to the specified sector (1..15)
-
-    Note that this function assumes that the Mifare Classic card is
-    already formatted to work as an "NFC Forum Tag" and uses a MAD1
-    file system.  You can use the NXP TagWriter app on Android to
-    properly format cards for this.
+    Tries to write the NDEF data (according to 5.4.7 in spec)
 
-    @param  sectorNumber  The sector that the URI record should be written
-                          to (can be 1..15 for a 1K card)
-    @param  uriIdentifier The uri identifier code (0 = none, 0x01 =
-                          "http://www.", etc.)
-    @param  url           The uri text to write (max 38 characters).
+    @param  length      Length of data in buffer
+    @param  data        The byte array that contains the data to write.
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareclassic_WriteNDEFURI (uint8_t sectorNumber, uint8_t uriIdentifier, const char *url)
+uint8_t PN532::type4_WriteFile (uint8_t length, uint8_t *data)
 {
-    // Figure out how long the string is
-    uint8_t len = strlen(url);
+    uint16_t buf_length;
+    uint8_t buffer[32];
 
-    // Make sure we're within a 1K limit for the sector number
-    if ((sectorNumber < 1) || (sectorNumber > 15))
+    if (!type4_select_ndef_application()) {
         return 0;
+    }
 
-    // Make sure the URI payload is between 1 and 38 chars
-    if ((len < 1) || (len > 38))
+    if (!type4_select_cc()) {
         return 0;
+    }
 
-    // Note 0xD3 0xF7 0xD3 0xF7 0xD3 0xF7 must be used for key A
-    // in NDEF records
+    if (!type4_read_cc(&buf_length, buffer, sizeof(buffer))) {
+        return 0;
+    }
 
-    // Setup the sector buffer (w/pre-formatted TLV wrapper and NDEF message)
-    uint8_t sectorbuffer1[16] = {0x00, 0x00, 0x03, len + 5, 0xD1, 0x01, len + 1, 0x55, uriIdentifier, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t sectorbuffer2[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t sectorbuffer3[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t sectorbuffer4[16] = {0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7, 0x7F, 0x07, 0x88, 0x40, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    if (len <= 6) {
-        // Unlikely we'll get a url this short, but why not ...
-        memcpy (sectorbuffer1 + 9, url, len);
-        sectorbuffer1[len + 9] = 0xFE;
-    } else if (len == 7) {
-        // 0xFE needs to be wrapped around to next block
-        memcpy (sectorbuffer1 + 9, url, len);
-        sectorbuffer2[0] = 0xFE;
-    } else if ((len > 7) || (len <= 22)) {
-        // Url fits in two blocks
-        memcpy (sectorbuffer1 + 9, url, 7);
-        memcpy (sectorbuffer2, url + 7, len - 7);
-        sectorbuffer2[len - 7] = 0xFE;
-    } else if (len == 23) {
-        // 0xFE needs to be wrapped around to final block
-        memcpy (sectorbuffer1 + 9, url, 7);
-        memcpy (sectorbuffer2, url + 7, len - 7);
-        sectorbuffer3[0] = 0xFE;
+    /* Check mapping version */
+    if (buffer[2] >> 4 == TYPE4_MAPPING_MAJOR) {
+        if (buffer[2] & 0x0F > TYPE4_MAPPING_MINOR) {
+            DMSG_STR("WARNING : Mapping minor version outdated, Tag may have additionnal features not implemented on this device");
+        }
     } else {
-        // Url fits in three blocks
-        memcpy (sectorbuffer1 + 9, url, 7);
-        memcpy (sectorbuffer2, url + 7, 16);
-        memcpy (sectorbuffer3, url + 23, len - 24);
-        sectorbuffer3[len - 22] = 0xFE;
+        DMSG_STR("Mapping version not implemented");
+        return 0;
     }
 
-    // Now write all three blocks back to the card
-    if (!(mifareclassic_WriteDataBlock (sectorNumber * 4, sectorbuffer1)))
+    if (buffer[13] != 0x00) {
+        DMSG_STR("File isn't readable");
         return 0;
-    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 1, sectorbuffer2)))
+    }
+
+    if (buffer[14] != 0x00) {
+        DMSG_STR("File isn't writeable");
         return 0;
-    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 2, sectorbuffer3)))
+    }
+
+    uint16_t file_id = buffer[9] << 8 | buffer[10];
+    uint16_t max_length = buffer[11] << 8 | buffer[12];
+
+    if (length > max_length - 2) {
+        DMSG_STR("Data to write is too long");
+        return 0;
+    }
+
+    if (!type4_select_ndef(file_id)) {
+        return 0;
+    }
+
+    if (!type4_write_ndef(length, data)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**************************************************************************/
+/*!
+    Reads the NDEF message and hands it to sink chunk by chunk, so no
+    buffer of the message size is needed.  Chunks are as large as the
+    MLe of the tag and pn532_packetbuffer allow.  The chunks live in
+    pn532_packetbuffer: sink must not send commands to the PN532.
+
+    @param  sink        Called with each chunk, in order
+    @param  length      Length of the NDEF message (out)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_ReadNDEF (ndefSink sink, uint16_t *length)
+{
+    uint8_t cc[TYPE4_CC_SIZE];
+    uint16_t cc_length;
+    type4_cc_t params;
+
+    if (!type4_select_ndef_application()) {
+        return 0;
+    }
+
+    if (!type4_select_cc()) {
+        return 0;
+    }
+
+    if (!type4_read_cc(&cc_length, cc, sizeof(cc)) || !type4_parse_cc(cc, &params)) {
+        return 0;
+    }
+
+    if (cc[2] >> 4 != TYPE4_MAPPING_MAJOR) {
+        DMSG_STR("Mapping version not implemented");
+        return 0;
+    }
+
+    if (params.readAccess != 0x00) {
+        DMSG_STR("File isn't readable");
+        return 0;
+    }
+
+    if (!type4_select_ndef(params.fileId)) {
+        return 0;
+    }
+
+    uint8_t nlen[2];
+    if (2 != type4_read_binary(0, 2, nlen)) {
+        return 0;
+    }
+
+    *length = nlen[0] << 8 | nlen[1];
+    if (*length > params.maxNdefSize - 2) {
+        DMSG_STR("Invalid NDEF length");
+        return 0;
+    }
+
+    uint8_t chunk = type4_chunk_size();
+    for (uint16_t offset = 0; offset < *length; ) {
+        uint8_t le = (*length - offset < chunk) ? *length - offset : chunk;
+        int16_t status = type4_read_binary(2 + offset, le, pn532_packetbuffer + 1);
+        if (status <= 0) {
+            return 0;
+        }
+        sink(pn532_packetbuffer + 1, status);
+        offset += status;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Writes an NDEF message taken from source chunk by chunk, so no buffer
+    of the message size is needed.  NLEN is committed last, see
+    type4_write_ndef_stream.
+
+    @param  source      Provides the message, in order
+    @param  length      Length of the NDEF message
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type4_WriteNDEF (ndefSource source, uint16_t length)
+{
+    uint8_t cc[TYPE4_CC_SIZE];
+    uint16_t cc_length;
+    type4_cc_t params;
+
+    if (!type4_select_ndef_application()) {
+        return 0;
+    }
+
+    if (!type4_select_cc()) {
+        return 0;
+    }
+
+    if (!type4_read_cc(&cc_length, cc, sizeof(cc)) || !type4_parse_cc(cc, &params)) {
+        return 0;
+    }
+
+    if (cc[2] >> 4 != TYPE4_MAPPING_MAJOR) {
+        DMSG_STR("Mapping version not implemented");
+        return 0;
+    }
+
+    if (params.writeAccess != 0x00) {
+        DMSG_STR("File isn't writeable");
+        return 0;
+    }
+
+    if (length > params.maxNdefSize - 2) {
+        DMSG_STR("Data to write is too long");
+        return 0;
+    }
+
+    if (!type4_select_ndef(params.fileId)) {
+        return 0;
+    }
+
+    return type4_write_ndef_stream(source, 0, length);
+}
+
+/**************************************************************************/
+/*!
+    Polls for an ISO14443B card and inlists it.  The PN532 activates it
+    with ATTRIB, so inDataExchange and ISO7816 work with it as with an
+    ISO14443-4A card.
+
+    @param  afi         Application family to poll, ISO14443B_AFI_ANY
+                        for any card
+    @param  target      Receives the ATQB and ATTRIB_RES of the card
+    @param  timeout     Time to wait for a card in ms
+
+    @returns 1 if a card answered, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::iso14443b_Polling (uint8_t afi, iso14443b_target_t *target, uint16_t timeout)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    pn532_packetbuffer[1] = 1;
+    pn532_packetbuffer[2] = PN532_ISO14443B;
+    pn532_packetbuffer[3] = afi;
+
+    if (writeCommand(pn532_packetbuffer, 4)) {
+        return 0;
+    }
+
+    int16_t length = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (length < 0) {
+        return 0;
+    }
+
+    /* ISO14443B response:
+
+      byte            Description
+      -------------   ------------------------------------------
+      b0              Tags Found
+      b1              Tag Number
+      b2..13          ATQB: 0x50, PUPI, Application Data, Protocol Info
+      b14             ATTRIB_RES length
+      b15..           ATTRIB_RES
+    */
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (pn532_packetbuffer[0] != 1) {
         return 0;
-    if (!(mifareclassic_WriteDataBlock ((sectorNumber * 4) + 3, sectorbuffer4)))
+    }
+
+    if (length < 15 || pn532_packetbuffer[2] != 0x50) {
+        DMSG_STR("Invalid ATQB");
         return 0;
+    }
+
+    inListedTag = pn532_packetbuffer[1];
+    memcpy(target->pupi, pn532_packetbuffer + 3, 4);
+    memcpy(target->applicationData, pn532_packetbuffer + 7, 4);
+    memcpy(target->protocolInfo, pn532_packetbuffer + 11, 3);
+
+    target->attribResLength = pn532_packetbuffer[14];
+    if (target->attribResLength > length - 15) {
+        target->attribResLength = length - 15;
+    }
+    if (target->attribResLength > sizeof(target->attribRes)) {
+        target->attribResLength = sizeof(target->attribRes);
+    }
+    memcpy(target->attribRes, pn532_packetbuffer + 15, target->attribResLength);
 
-    // Seems that everything was OK (?!)
     return 1;
 }
 
-/***** Mifare Ultralight Functions ******/
+/**************************************************************************/
+/*!
+    Longest frame the ISO14443B card accepts (FSCI of its Protocol Info)
+
+    @returns The frame size in bytes, CRC included
+*/
+/**************************************************************************/
+uint16_t PN532::iso14443b_MaxFrameSize (const iso14443b_target_t *target)
+{
+    static const uint8_t sizes[] = { 16, 24, 32, 40, 48, 64, 96, 128 };
+    uint8_t fsci = target->protocolInfo[1] >> 4;
+
+    return (fsci < sizeof(sizes)) ? sizes[fsci] : 256;
+}
 
 /**************************************************************************/
 /*!
-    Tries to read an entire 4-bytes page at the specified address.
+    Polls for an Innovision Jewel / Topaz card (NFC Forum Type 1 Tag) and
+    inlists it
 
-    @param  page        The page number (0..63 in most cases)
-    @param  buffer      Pointer to the byte array that will hold the
-                        retrieved data (if any)
+    @param  uid         UID of the card, 4 bytes (out)
+    @param  timeout     Time to wait for a card in ms
+
+    @returns 1 if a card answered, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareultralight_ReadPage (uint8_t page, uint8_t *buffer)
+bool PN532::jewel_Polling (uint8_t *uid, uint16_t timeout)
 {
-    if (page >= 64) {
-        DMSG("Page value out of range\n");
+    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    pn532_packetbuffer[1] = 1;
+    pn532_packetbuffer[2] = PN532_JEWEL;
+
+    if (writeCommand(pn532_packetbuffer, 3)) {
         return 0;
     }
 
-    /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                   /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ;     /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = page;                /* Page Number (0..63 in most cases) */
-
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, 4)) {
+    int16_t length = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (length < 0) {
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    /* Jewel response:
 
-    /* If byte 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[0] == 0x00) {
-        /* Copy the 4 data bytes to the output buffer         */
-        /* Block content starts at byte 9 of a valid response */
-        /* Note that the command actually reads 16 bytes or 4  */
-        /* pages at a time ... we simply discard the last 12  */
-        /* bytes                                              */
-        memcpy (buffer, pn532_packetbuffer + 1, 4);
-    } else {
+      byte            Description
+      -------------   ------------------------------------------
+      b0              Tags Found
+      b1              Tag Number
+      b2..3           SENS_RES
+      b4..7           JEWELID (UID)
+    */
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (pn532_packetbuffer[0] != 1 || length < 8) {
         return 0;
     }
 
-    // Return OK signal
+    inListedTag = pn532_packetbuffer[1];
+    memcpy(_jewelUid, pn532_packetbuffer + 4, 4);
+    memcpy(uid, pn532_packetbuffer + 4, 4);
+
     return 1;
 }
 
 /**************************************************************************/
 /*!
-    Tries to write an entire 4-bytes data buffer at the specified page
-    address.
+    Reads the header ROM and UID of the inlisted Jewel / Topaz card (RID)
 
-    @param  page     The page number to write into.  (0..63).
-    @param  buffer   The byte array that contains the data to write.
+    @param  header      HR0 HR1 (out), HR0 0x1x for NDEF capable tags
+    @param  uid         UID0..UID3 (out)
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::mifareultralight_WritePage (uint8_t page, uint8_t *buffer)
+uint8_t PN532::jewel_ReadID (uint8_t *header, uint8_t *uid)
 {
-    /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                           /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_WRITE_ULTRALIGHT; /* Mifare UL Write cmd = 0xA2 */
-    pn532_packetbuffer[3] = page;                        /* page Number (0..63) */
-    memcpy (pn532_packetbuffer + 4, buffer, 4);          /* Data Payload */
-
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, 8)) {
+    if (6 != jewel_Command(JEWEL_CMD_RID, 0x00, 0, 1, pn532_packetbuffer, _packetBufferSize)) {
         return 0;
     }
 
-    /* Read the response packet */
-    return (0 < HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer)));
+    memcpy(header, pn532_packetbuffer, 2);
+    memcpy(uid, pn532_packetbuffer + 2, 4);
+
+    return 1;
 }
 
+/**************************************************************************/
+/*!
+    Reads the whole static memory of the inlisted Jewel / Topaz card
+    with one RALL: HR0 HR1, then blocks 0x0 to 0xE (UID, data, lock and
+    OTP bytes).  The answer is longer than pn532_packetbuffer, so it is
+    received in buffer.
 
-/***** NFC Forum Type 4 Tag Functions ******/
+    @param  buffer      JEWEL_RALL_BUFFER_SIZE bytes, gets the
+                        JEWEL_RALL_SIZE bytes of the answer
+
+    @returns Length of the answer, or -1 for an error
+*/
+/**************************************************************************/
+int16_t PN532::jewel_ReadAll (uint8_t *buffer)
+{
+    int16_t length = jewel_Command(JEWEL_CMD_RALL, 0x00, 0, 1, buffer, JEWEL_RALL_BUFFER_SIZE);
+
+    if (length != JEWEL_RALL_SIZE) {
+        return -1;
+    }
+
+    return length;
+}
 
 /**************************************************************************/
 /*!
-    Selects NDEF application on target
+    Reads one byte of the inlisted Jewel / Topaz card (READ)
+
+    @param  address     Block (bits 6..3) and byte (bits 2..0)
+    @param  data        The byte (out)
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_select_ndef_application () {
-    uint8_t c_apdu[] = {
-        0x00, 0xA4, 0x04, 0x00, 0x07,
-        0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00
-    };
+uint8_t PN532::jewel_ReadByte (uint8_t address, uint8_t *data)
+{
+    if (2 != jewel_Command(JEWEL_CMD_READ, address, 0, 1, pn532_packetbuffer, _packetBufferSize) ||
+            pn532_packetbuffer[0] != address) {
+        return 0;
+    }
 
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    *data = pn532_packetbuffer[1];
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (select ndef application)");
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Erases and writes one byte of the inlisted Jewel / Topaz card
+    (WRITE-E)
+
+    @param  address     Block (bits 6..3) and byte (bits 2..0)
+    @param  data        The byte
+
+    @returns 1 if the card acknowledged the byte, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::jewel_WriteByte (uint8_t address, uint8_t data)
+{
+    if (2 != jewel_Command(JEWEL_CMD_WRITE_E, address, &data, 1, pn532_packetbuffer, _packetBufferSize) ||
+            pn532_packetbuffer[0] != address || pn532_packetbuffer[1] != data) {
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    return 1;
+}
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (select ndef application)");
+/**************************************************************************/
+/*!
+    Reads one 8 bytes block of the inlisted Topaz 512 card (READ8)
+
+    @param  block       Block number
+    @param  data        JEWEL_BLOCK_SIZE bytes (out)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::jewel_ReadBlock (uint8_t block, uint8_t *data)
+{
+    if (1 + JEWEL_BLOCK_SIZE != jewel_Command(JEWEL_CMD_READ8, block, 0, JEWEL_BLOCK_SIZE, pn532_packetbuffer, _packetBufferSize) ||
+            pn532_packetbuffer[0] != block) {
         return 0;
     }
 
-    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
-        DMSG_STR("Error in ndef application selection");
+    memcpy(data, pn532_packetbuffer + 1, JEWEL_BLOCK_SIZE);
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Erases and writes one 8 bytes block of the inlisted Topaz 512 card
+    (WRITE-E8)
+
+    @param  block       Block number
+    @param  data        JEWEL_BLOCK_SIZE bytes to write
+
+    @returns 1 if the card acknowledged the block, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::jewel_WriteBlock (uint8_t block, const uint8_t *data)
+{
+    if (1 + JEWEL_BLOCK_SIZE != jewel_Command(JEWEL_CMD_WRITE_E8, block, data, JEWEL_BLOCK_SIZE, pn532_packetbuffer, _packetBufferSize) ||
+            pn532_packetbuffer[0] != block || memcmp(pn532_packetbuffer + 1, data, JEWEL_BLOCK_SIZE)) {
         return 0;
     }
 
@@ -729,122 +2953,190 @@ uint8_t PN532::type4_select_ndef_application () {
 
 /**************************************************************************/
 /*!
-    Selects capability container file on target
+    Sends a Jewel / Topaz command: code, address, data (zeros if data is
+    0) and the UID of the card; the PN532 adds the CRC.  The answer,
+    status byte removed, is left in response.
 
-    @returns 1 if everything executed properly, 0 for an error
+    @returns Length of the answer, or -1 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_select_cc () {
-    uint8_t c_apdu[] = {
-        0x00, 0xA4, 0x00, 0x0C, 0x02, 0xE1, 0x03
-    };
-
+int16_t PN532::jewel_Command (uint8_t command, uint8_t address, const uint8_t *data, uint8_t dataLength,
+                              uint8_t *response, uint8_t responseSize)
+{
     pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    pn532_packetbuffer[1] = inListedTag;
+    pn532_packetbuffer[2] = command;
+    pn532_packetbuffer[3] = address;
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (select cc)");
-        return 0;
+    uint8_t length = 4;
+    for (uint8_t i = 0; i < dataLength; i++) {
+        pn532_packetbuffer[length++] = data ? data[i] : 0x00;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    // RID is sent before the UID is known, with zeros in its place
+    if (JEWEL_CMD_RID == command) {
+        memset(pn532_packetbuffer + length, 0, 4);
+    } else {
+        memcpy(pn532_packetbuffer + length, _jewelUid, 4);
+    }
+    length += 4;
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (select cc)");
-        return 0;
+    if (writeCommand(pn532_packetbuffer, length)) {
+        return -1;
     }
 
-    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
-        DMSG_STR("Error in cc file selection");
-        return 0;
+    int16_t status = readResponse(response, responseSize);
+    if (status < 1 || checkStatus(response[0])) {
+        return -1;
     }
 
-    return 1;
+    memmove(response, response + 1, status - 1);
+
+    return status - 1;
 }
 
 /**************************************************************************/
 /*!
-    Selects NDEF file on target
-
-    @param  file_id     ID of the ndef file given in CC
-
-    @returns 1 if everything executed properly, 0 for an error
+    Polls for a FeliCa card and inlists it
+
+    @param  systemCode          System code to poll, FELICA_SYSTEM_CODE_ANY
+                                for any card
+    @param  requestCode         FELICA_REQUEST_xxx, extra data wanted
+    @param  idm                 IDm of the card, 8 bytes (out)
+    @param  pmm                 PMm of the card, 8 bytes (out), may be 0
+    @param  systemCodeResponse  System code of the card (out), set with
+                                FELICA_REQUEST_SYSTEM_CODE, may be 0
+    @param  baudrate            PN532_FELICA_212 or PN532_FELICA_424
+    @param  timeout             Time to wait for a card in ms
+
+    @returns 1 if a card answered, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_select_ndef (uint16_t file_id) {
-    uint8_t c_apdu[] = {
-        0x00, 0xA4, 0x00, 0x0C, 0x02, file_id >> 8, file_id & 0xFF
-    };
-
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+uint8_t PN532::felica_Polling (uint16_t systemCode, uint8_t requestCode, uint8_t *idm, uint8_t *pmm, uint16_t *systemCodeResponse,
+                               uint8_t baudrate, uint16_t timeout)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
     pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    pn532_packetbuffer[2] = baudrate;
+    pn532_packetbuffer[3] = 0x00;   // POLLING
+    pn532_packetbuffer[4] = systemCode >> 8;
+    pn532_packetbuffer[5] = systemCode & 0xFF;
+    pn532_packetbuffer[6] = requestCode;
+    pn532_packetbuffer[7] = 0x00;   // one time slot
+
+    if (writeCommand(pn532_packetbuffer, 8)) {
+        return 0;
+    }
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (select ndef)");
+    int16_t length = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (length < 0) {
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    /* FeliCa response:
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (select ndef)");
+      byte            Description
+      -------------   ------------------------------------------
+      b0              Tags Found
+      b1              Tag Number
+      b2              POL_RES length
+      b3              Response code (0x01)
+      b4..11          IDm
+      b12..19         PMm
+      b20..21         System code, if requested
+    */
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (pn532_packetbuffer[0] != 1) {
         return 0;
     }
 
-    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
-        DMSG_STR("Error in ndef file selection");
+    if (length < 20 || pn532_packetbuffer[2] < 18 || pn532_packetbuffer[3] != 0x01) {
+        DMSG_STR("Invalid POL_RES");
         return 0;
     }
 
+    inListedTag = pn532_packetbuffer[1];
+    memcpy(_felicaIDm, pn532_packetbuffer + 4, 8);
+    memcpy(idm, pn532_packetbuffer + 4, 8);
+    if (pmm) {
+        memcpy(pmm, pn532_packetbuffer + 12, 8);
+    }
+    if (systemCodeResponse && length >= 22 && pn532_packetbuffer[2] >= 20) {
+        *systemCodeResponse = pn532_packetbuffer[20] << 8 | pn532_packetbuffer[21];
+    }
+
     return 1;
 }
 
 /**************************************************************************/
 /*!
-    Reads CC file after having selected it
+    Reads consecutive blocks of a service, as many per command as
+    pn532_packetbuffer can receive
 
-    @param  length      Actual length of CC file (out)
-    @param  buffer      Pointer to the byte array that will hold the
-                        retrieved data (if any)
+    @param  serviceCode   Service code of the blocks
+    @param  firstBlock    Number of the first block
+    @param  count         Number of blocks
+    @param  data          Receives count * FELICA_BLOCK_SIZE bytes
+    @param  maxBlocks     Blocks per command the card accepts, 0 if any
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_read_cc (uint16_t *length, uint8_t *buffer) {
-    uint8_t c_apdu[] = {
-        0x00, 0xB0, 0x00, 0x00, 0x0F
-    };
+uint8_t PN532::felica_ReadWithoutEncryption (uint16_t serviceCode, uint16_t firstBlock, uint16_t count, uint8_t *data, uint8_t maxBlocks)
+{
+    uint8_t perCommand = felica_ReadBlocksMax();
+    if (maxBlocks && maxBlocks < perCommand) {
+        perCommand = maxBlocks;
+    }
 
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    while (count) {
+        uint8_t blocks = (count < perCommand) ? count : perCommand;
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (read cc)");
-        return 0;
+        if (!felica_ReadChunk(serviceCode, firstBlock, blocks)) {
+            return 0;
+        }
+        memcpy(data, pn532_packetbuffer + 14, blocks * FELICA_BLOCK_SIZE);
+
+        data += blocks * FELICA_BLOCK_SIZE;
+        firstBlock += blocks;
+        count -= blocks;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    return 1;
+}
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (read cc)");
-        return 0;
-    }
+/**************************************************************************/
+/*!
+    Writes consecutive blocks of a service, as many per command as a
+    FeliCa frame can carry
 
-    *length = pn532_packetbuffer[1] << 8 | pn532_packetbuffer[2];
-    memcpy (buffer, pn532_packetbuffer + 1, *length);
+    @param  serviceCode   Service code of the blocks
+    @param  firstBlock    Number of the first block
+    @param  count         Number of blocks
+    @param  data          count * FELICA_BLOCK_SIZE bytes to write
+    @param  maxBlocks     Blocks per command the card accepts, 0 if any
 
-    if (pn532_packetbuffer[*length + 1] != 0x90 || pn532_packetbuffer[*length + 2] != 0x00) {
-        DMSG_STR("Error in cc reading");
-        return 0;
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::felica_WriteWithoutEncryption (uint16_t serviceCode, uint16_t firstBlock, uint16_t count, const uint8_t *data, uint8_t maxBlocks)
+{
+    while (count) {
+        // The data is sent from the caller's buffer, only the frame limits the blocks
+        uint8_t blocks = felica_WriteBlocksMax(firstBlock, count, FELICA_FRAME_SIZE - 14, maxBlocks);
+        uint8_t length = felica_BlockCommand(FELICA_CMD_WRITE_WITHOUT_ENCRYPTION, serviceCode, firstBlock, blocks);
+
+        if (!felica_Exchange(length, data, blocks * FELICA_BLOCK_SIZE)) {
+            return 0;
+        }
+
+        data += blocks * FELICA_BLOCK_SIZE;
+        firstBlock += blocks;
+        count -= blocks;
     }
 
     return 1;
@@ -852,67 +3144,118 @@ uint8_t PN532::type4_read_cc (uint16_t *length, uint8_t *buffer) {
 
 /**************************************************************************/
 /*!
-    Reads NDEF file after having selected it
+    Number of blocks of the next write command: the block list elements
+    (2 bytes, 3 past block 255) and data must fit in room bytes
+*/
+/**************************************************************************/
+uint8_t PN532::felica_WriteBlocksMax (uint16_t firstBlock, uint16_t count, uint8_t room, uint8_t maxBlocks)
+{
+    uint8_t element = (firstBlock + count - 1 > 0xFF) ? 3 : 2;
+    uint8_t blocks = room / (FELICA_BLOCK_SIZE + element);
 
-    @param  length      Actual length of NDEF file (out)
-    @param  buffer      Pointer to the byte array that will hold the
-                        retrieved data (if any)
+    if (maxBlocks && maxBlocks < blocks) {
+        blocks = maxBlocks;
+    }
+    if (count < blocks) {
+        blocks = count;
+    }
+
+    return blocks;
+}
+
+/**************************************************************************/
+/*!
+    Builds a Read/Write Without Encryption command for count blocks of
+    one service in pn532_packetbuffer, up to the block list
+
+    @returns Length of the command in pn532_packetbuffer
+*/
+/**************************************************************************/
+uint8_t PN532::felica_BlockCommand (uint8_t code, uint16_t serviceCode, uint16_t firstBlock, uint8_t count)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = inListedTag;
+    // pn532_packetbuffer[2] is the frame length, set by felica_Exchange
+    pn532_packetbuffer[3] = code;
+    memcpy(pn532_packetbuffer + 4, _felicaIDm, 8);
+    pn532_packetbuffer[12] = 1;                     // number of services
+    pn532_packetbuffer[13] = serviceCode & 0xFF;    // little endian
+    pn532_packetbuffer[14] = serviceCode >> 8;
+    pn532_packetbuffer[15] = count;
+
+    uint8_t length = 16;
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t block = firstBlock + i;
+        if (block > 0xFF) {
+            pn532_packetbuffer[length++] = 0x00;    // 3 bytes element, service 0
+            pn532_packetbuffer[length++] = block & 0xFF;
+            pn532_packetbuffer[length++] = block >> 8;
+        } else {
+            pn532_packetbuffer[length++] = 0x80;    // 2 bytes element, service 0
+            pn532_packetbuffer[length++] = block;
+        }
+    }
+
+    return length;
+}
+
+/**************************************************************************/
+/*!
+    Sends the FeliCa command in pn532_packetbuffer, followed by body, and
+    checks the answer.  The answer is left in pn532_packetbuffer: status
+    byte, length, response code, IDm, SF1, SF2, then the command data.
 
-    @returns 1 if everything executed properly, 0 for an error
+    @returns the length of the answer (13 at least) if the card executed
+             the command, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_read_ndef (uint16_t *length, uint8_t *buffer) {
-    /* Read file length */
-    uint8_t c_apdu[] = {
-        0x00, 0xB0, 0x00, 0x00, 0x02
-    };
+uint8_t PN532::felica_Exchange (uint8_t length, const uint8_t *body, uint8_t bodyLength)
+{
+    uint8_t code = pn532_packetbuffer[3];
 
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    pn532_packetbuffer[2] = length - 2 + bodyLength;
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (read ndef length)");
+    if (writeCommand(pn532_packetbuffer, length, body, bodyLength)) {
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
-
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (read ndef length)");
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize);
+    if (status < 1 || checkStatus(pn532_packetbuffer[0])) {
         return 0;
     }
 
-    *length = pn532_packetbuffer[1] << 8 | pn532_packetbuffer[2];
-
-    /* Read file */
-    c_apdu[3] = 0x02;
-    c_apdu[4] = *length & 0xFF;
-
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+    if (status < 13 || pn532_packetbuffer[2] != code + 1 || memcmp(pn532_packetbuffer + 3, _felicaIDm, 8)) {
+        DMSG_STR("Invalid FeliCa response");
+        return 0;
+    }
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (read ndef)");
+    _felicaStatus = pn532_packetbuffer[11] << 8 | pn532_packetbuffer[12];
+    if (pn532_packetbuffer[11]) {
+        DMSG("FeliCa status flags: 0x"); DMSG_HEX(_felicaStatus); DMSG("\n");
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    return status;
+}
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (read ndef)");
+/**************************************************************************/
+/*!
+    Reads count blocks with one command, the data is left at
+    pn532_packetbuffer + 14
+*/
+/**************************************************************************/
+uint8_t PN532::felica_ReadChunk (uint16_t serviceCode, uint16_t firstBlock, uint8_t count)
+{
+    uint8_t length = felica_BlockCommand(FELICA_CMD_READ_WITHOUT_ENCRYPTION, serviceCode, firstBlock, count);
+
+    uint8_t received = felica_Exchange(length);
+    if (!received) {
         return 0;
     }
 
-    memcpy (buffer, pn532_packetbuffer + 1, *length);
-
-    if (pn532_packetbuffer[*length + 1] != 0x90 || pn532_packetbuffer[*length + 2] != 0x00) {
-        DMSG_STR("Error in cc reading");
+    // Block count and data must all be there before being looked at
+    if (received < 14 + count * FELICA_BLOCK_SIZE || pn532_packetbuffer[13] != count) {
+        DMSG_STR("Blocks missing");
         return 0;
     }
 
@@ -921,197 +3264,242 @@ uint8_t PN532::type4_read_ndef (uint16_t *length, uint8_t *buffer) {
 
 /**************************************************************************/
 /*!
-    Tries to write NDEF file to the target after having selected it
+    Parses the Attribute Information Block of a Type 3 Tag
 
-    @param  length     Length of data to write
-    @param  data       The byte array that contains the data to write.
+    @param  block       The 16 bytes of block 0
+    @param  attribute   Receives the parameters
 
-    @returns 1 if everything executed properly, 0 for an error
+    @returns 1 if the checksum is right, 0 otherwise
 */
 /**************************************************************************/
-uint8_t PN532::type4_write_ndef (uint8_t length, uint8_t *data) {
-    uint8_t c_apdu[] = {
-        0x00, 0xD6, 0x00, 0x00, length + 2, 0x00, 0x00
-    };
-
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
-    memcpy(pn532_packetbuffer + 2 + sizeof(c_apdu), data, length);
+uint8_t PN532::type3_parse_attribute (const uint8_t *block, type3_attribute_t *attribute)
+{
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < 14; i++) {
+        sum += block[i];
+    }
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2 + length)) {
-        DMSG_STR("Error in writing command (write ndef)");
+    if (sum != (block[14] << 8 | block[15])) {
+        DMSG_STR("Wrong attribute checksum");
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    attribute->version = block[0];
+    attribute->nbr = block[1];
+    attribute->nbw = block[2];
+    attribute->nmaxb = block[3] << 8 | block[4];
+    attribute->writeFlag = block[9];
+    attribute->rwFlag = block[10];
+    attribute->length = (uint32_t)block[11] << 16 | block[12] << 8 | block[13];
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (write ndef)");
-        return 0;
-    }
+    return 1;
+}
 
-    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
-        DMSG_STR("Error in ndef file writing");
-        return 0;
-    }
+/**************************************************************************/
+/*!
+    Builds the Attribute Information Block of a Type 3 Tag, checksum
+    included
 
-    c_apdu[4] = 0x02;
-    c_apdu[5] = length >> 8;
-    c_apdu[6] = length & 0xFF;
+    @param  attribute   The parameters
+    @param  block       Receives the 16 bytes of block 0
+*/
+/**************************************************************************/
+void PN532::type3_build_attribute (const type3_attribute_t *attribute, uint8_t *block)
+{
+    memset(block, 0, FELICA_BLOCK_SIZE);
+    block[0] = attribute->version;
+    block[1] = attribute->nbr;
+    block[2] = attribute->nbw;
+    block[3] = attribute->nmaxb >> 8;
+    block[4] = attribute->nmaxb & 0xFF;
+    block[9] = attribute->writeFlag;
+    block[10] = attribute->rwFlag;
+    block[11] = attribute->length >> 16;
+    block[12] = attribute->length >> 8;
+    block[13] = attribute->length & 0xFF;
+
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < 14; i++) {
+        sum += block[i];
+    }
+    block[14] = sum >> 8;
+    block[15] = sum & 0xFF;
+}
 
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;
-    memcpy(pn532_packetbuffer + 2, c_apdu, sizeof(c_apdu));
+/**************************************************************************/
+/*!
+    Reads and checks the Attribute Information Block of the inlisted
+    Type 3 Tag (polled with TYPE3_SYSTEM_CODE)
 
-    /* Send the command */
-    if (HAL(writeCommand)(pn532_packetbuffer, sizeof(c_apdu) + 2)) {
-        DMSG_STR("Error in writing command (write ndef length)");
+    @param  attribute   Receives the parameters
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t PN532::type3_read_attribute (type3_attribute_t *attribute)
+{
+    if (!felica_ReadChunk(TYPE3_SERVICE_READ, 0, 1)) {
         return 0;
     }
 
-    /* Read the response packet */
-    HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    if (!type3_parse_attribute(pn532_packetbuffer + 14, attribute)) {
+        return 0;
+    }
 
-    if (pn532_packetbuffer[0]) {
-        DMSG_STR("Error while reading data (write ndef length)");
+    if (attribute->version >> 4 != TYPE3_MAPPING_MAJOR) {
+        DMSG_STR("Mapping version not implemented");
         return 0;
     }
 
-    if (pn532_packetbuffer[1] != 0x90 || pn532_packetbuffer[2] != 0x00) {
-        DMSG_STR("Error in ndef file length writing");
+    if (!attribute->nbr || !attribute->nbw) {
+        DMSG_STR("Invalid attribute");
         return 0;
     }
 
     return 1;
 }
 
+uint8_t PN532::type3_write_attribute (const type3_attribute_t *attribute)
+{
+    uint8_t block[FELICA_BLOCK_SIZE];
+
+    type3_build_attribute(attribute, block);
+
+    return felica_WriteWithoutEncryption(TYPE3_SERVICE_WRITE, 0, 1, block);
+}
+
 /**************************************************************************/
 /*!
-    Tries to read the NDEF data (according to 5.4.6 in spec)
+    Reads the NDEF message of the inlisted Type 3 Tag and hands it to
+    sink chunk by chunk, Nbr blocks or what pn532_packetbuffer holds at
+    a time.  The chunks live in pn532_packetbuffer: sink must not send
+    commands to the PN532.
 
-    @param  length      Actual length of retrieved data
-    @param  buffer      Pointer to the byte array that will hold the
-                        retrieved data (if any)
+    @param  sink        Called with each chunk, in order
+    @param  length      Length of the NDEF message (out)
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_ReadFile (uint8_t *length, uint8_t *buffer)
+uint8_t PN532::type3_ReadNDEF (ndefSink sink, uint16_t *length)
 {
-    uint16_t buf_length;
+    type3_attribute_t attribute;
 
-    if (!type4_select_ndef_application()) {
+    if (!type3_read_attribute(&attribute)) {
         return 0;
     }
 
-    if (!type4_select_cc()) {
+    if (attribute.writeFlag != TYPE3_WRITE_DONE) {
+        DMSG_STR("NDEF message being written");
         return 0;
     }
 
-    if (!type4_read_cc(&buf_length, buffer)) {
+    if (attribute.length > 0xFFFF || attribute.length > (uint32_t)attribute.nmaxb * FELICA_BLOCK_SIZE) {
+        DMSG_STR("Invalid NDEF length");
         return 0;
     }
 
-    /* Check mapping version */
-    if (buffer[2] >> 4 == TYPE4_MAPPING_MAJOR) {
-        if (buffer[2] & 0x0F > TYPE4_MAPPING_MINOR) {
-            DMSG_STR("WARNING : Mapping minor version outdated, Tag may have additionnal features not implemented on this device");
-        }
-    } else {
-        DMSG_STR("Mapping version not implemented");
-        return 0;
-    }
+    *length = attribute.length;
 
-    if (buffer[13] != 0x00) {
-        DMSG_STR("File isn't readable");
-        return 0;
+    uint8_t perCommand = felica_ReadBlocksMax();
+    if (attribute.nbr < perCommand) {
+        perCommand = attribute.nbr;
     }
 
-    uint16_t file_id = buffer[9] << 8 | buffer[10];
+    uint16_t block = 1;
+    for (uint16_t offset = 0; offset < *length; ) {
+        uint16_t left = *length - offset;
+        uint16_t blocks = (left + FELICA_BLOCK_SIZE - 1) / FELICA_BLOCK_SIZE;
+        if (blocks > perCommand) {
+            blocks = perCommand;
+        }
 
-    if (!type4_select_ndef(file_id)) {
-        return 0;
-    }
+        if (!felica_ReadChunk(TYPE3_SERVICE_READ, block, blocks)) {
+            return 0;
+        }
 
-    if (!type4_read_ndef(&buf_length, buffer)) {
-        return 0;
-    }
+        uint16_t chunk = blocks * FELICA_BLOCK_SIZE;
+        if (chunk > left) {
+            chunk = left;
+        }
+        sink(pn532_packetbuffer + 14, chunk);
 
-    *length = buf_length & 0xFF;
+        offset += chunk;
+        block += blocks;
+    }
 
     return 1;
 }
 
 /**************************************************************************/
 /*!
-    Tries to write the NDEF data (according to 5.4.7 in spec)
+    Writes an NDEF message taken from source to the inlisted Type 3 Tag,
+    Nbw blocks or what pn532_packetbuffer holds at a time.  The attribute
+    block flags the write in progress until the last block is written,
+    then gets the new length.
 
-    @param  length      Length of data in buffer
-    @param  data        The byte array that contains the data to write.
+    @param  source      Provides the message, in order
+    @param  length      Length of the NDEF message
 
     @returns 1 if everything executed properly, 0 for an error
 */
 /**************************************************************************/
-uint8_t PN532::type4_WriteFile (uint8_t length, uint8_t *data)
+uint8_t PN532::type3_WriteNDEF (ndefSource source, uint16_t length)
 {
-    uint16_t buf_length;
-    uint8_t buffer[32];
+    type3_attribute_t attribute;
 
-    if (!type4_select_ndef_application()) {
+    if (!type3_read_attribute(&attribute)) {
         return 0;
     }
 
-    if (!type4_select_cc()) {
+    if (attribute.rwFlag != TYPE3_READ_WRITE) {
+        DMSG_STR("Tag is read only");
         return 0;
     }
 
-    if (!type4_read_cc(&buf_length, buffer)) {
+    if (length > (uint32_t)attribute.nmaxb * FELICA_BLOCK_SIZE) {
+        DMSG_STR("Data to write is too long");
         return 0;
     }
 
-    /* Check mapping version */
-    if (buffer[2] >> 4 == TYPE4_MAPPING_MAJOR) {
-        if (buffer[2] & 0x0F > TYPE4_MAPPING_MINOR) {
-            DMSG_STR("WARNING : Mapping minor version outdated, Tag may have additionnal features not implemented on this device");
-        }
-    } else {
-        DMSG_STR("Mapping version not implemented");
+    attribute.writeFlag = TYPE3_WRITE_IN_PROGRESS;
+    if (!type3_write_attribute(&attribute)) {
         return 0;
     }
 
-    if (buffer[13] != 0x00) {
-        DMSG_STR("File isn't readable");
-        return 0;
-    }
+    uint16_t block = 1;
+    for (uint16_t offset = 0; offset < length; ) {
+        uint16_t left = length - offset;
+        uint16_t count = (left + FELICA_BLOCK_SIZE - 1) / FELICA_BLOCK_SIZE;
 
-    if (buffer[14] != 0x00) {
-        DMSG_STR("File isn't writeable");
-        return 0;
-    }
+        // The blocks are filled in pn532_packetbuffer, after the command
+        uint8_t blocks = felica_WriteBlocksMax(block, count, _packetBufferSize - 16, attribute.nbw);
+        uint8_t header = felica_BlockCommand(FELICA_CMD_WRITE_WITHOUT_ENCRYPTION, TYPE3_SERVICE_WRITE, block, blocks);
+        uint16_t chunk = blocks * FELICA_BLOCK_SIZE;
+        if (chunk > left) {
+            chunk = left;
+        }
 
-    uint16_t file_id = buffer[9] << 8 | buffer[10];
-    uint16_t max_length = buffer[11] << 8 | buffer[12];
+        memset(pn532_packetbuffer + header, 0, blocks * FELICA_BLOCK_SIZE);
+        if (source(pn532_packetbuffer + header, offset, chunk) != chunk) {
+            DMSG_STR("NDEF source ended early");
+            return 0;
+        }
 
-    if (length > max_length - 2) {
-        DMSG_STR("Data to write is too long");
-        return 0;
-    }
+        if (!felica_Exchange(header + blocks * FELICA_BLOCK_SIZE)) {
+            return 0;
+        }
 
-    if (!type4_select_ndef(file_id)) {
-        return 0;
+        offset += chunk;
+        block += blocks;
     }
 
-    if (!type4_write_ndef(length, data)) {
-        return 0;
-    }
+    attribute.writeFlag = TYPE3_WRITE_DONE;
+    attribute.length = length;
 
-    return 1;
+    return type3_write_attribute(&attribute);
 }
 
-
 /**************************************************************************/
 /*!
     @brief  Exchanges an APDU with the currently inlisted peer
@@ -1129,16 +3517,16 @@ bool PN532::inDataExchange(uint8_t *send, uint8_t sendLength, uint8_t *response,
     pn532_packetbuffer[0] = 0x40; // PN532_COMMAND_INDATAEXCHANGE;
     pn532_packetbuffer[1] = inListedTag;
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 2, send, sendLength)) {
+    if (writeCommand(pn532_packetbuffer, 2, send, sendLength)) {
         return false;
     }
 
-    int16_t status = HAL(readResponse)(response, *responseLength, 1000);
-    if (status < 0) {
+    int16_t status = readResponse(response, *responseLength, 1000);
+    if (status < 1) {
         return false;
     }
 
-    if ((response[0] & 0x3f) != 0) {
+    if (checkStatus(response[0])) {
         DMSG("Status code indicates an error\n");
         return false;
     }
@@ -1158,6 +3546,49 @@ bool PN532::inDataExchange(uint8_t *send, uint8_t sendLength, uint8_t *response,
     return true;
 }
 
+/**************************************************************************/
+/*!
+    Exchanges one frame of a chain with the inlisted target.  With more
+    set, the PN532 is told that more data follows (MI bit) and only
+    acknowledges; it chains the frames to the card itself.  When the
+    answer doesn't fit in one frame, moreData is set and the rest is
+    fetched by calling again with no data.
+
+    @param  send          Data to send
+    @param  sendLength    Length of the data to send
+    @param  more          1 if more data follows this frame
+    @param  response      Buffer for the data received, status excluded
+    @param  responseSize  Size of the buffer
+    @param  moreData      Set to 1 if the PN532 holds more data
+
+    @returns Length of the data received, or -1 for an error
+*/
+/**************************************************************************/
+int16_t PN532::inDataExchangeChained(const uint8_t *send, uint8_t sendLength, bool more, uint8_t *response, uint8_t responseSize, bool *moreData)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = inListedTag | (more ? PN532_MI_BIT : 0);
+
+    if (writeCommand(pn532_packetbuffer, 2, send, sendLength)) {
+        return -1;
+    }
+
+    int16_t status = readResponse(response, responseSize, 1000);
+    if (status < 1) {
+        return -1;
+    }
+
+    if (checkStatus(response[0])) {
+        DMSG("Status code indicates an error\n");
+        return -1;
+    }
+
+    *moreData = response[0] & PN532_MI_BIT;
+    memmove(response, response + 1, status - 1);
+
+    return status - 1;
+}
+
 /**************************************************************************/
 /*!
     @brief  'InLists' a passive target. PN532 acting as reader/initiator,
@@ -1172,36 +3603,77 @@ bool PN532::inListPassiveTarget()
 
     DMSG("inList passive target\n");
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 3)) {
+    if (writeCommand(pn532_packetbuffer, 3)) {
         return false;
     }
 
-    int16_t status = HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer), 30000);
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize, 30000);
     if (status < 0) {
         return false;
     }
 
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
     if (pn532_packetbuffer[0] != 1) {
         return false;
     }
 
     inListedTag = pn532_packetbuffer[1];
+    recordTarget(status);
 
     return true;
 }
 
+/**************************************************************************/
+/*!
+    Keeps the SAK, uid and ATS of an ISO14443A target from an
+    InListPassiveTarget response in pn532_packetbuffer, so the card can
+    be checked or re-selected later and its capabilities (frame size,
+    bit rates, historical bytes) are known without a RATS
+*/
+/**************************************************************************/
+void PN532::recordTarget (int16_t length)
+{
+    uint8_t ats = 6 + pn532_packetbuffer[5];
+
+    _sak = pn532_packetbuffer[4];
+    _targetUidLen = pn532_packetbuffer[5];
+    if (_targetUidLen > sizeof(_targetUid)) {
+        _targetUidLen = 0;
+    }
+    memcpy(_targetUid, pn532_packetbuffer + 6, _targetUidLen);
+
+    _atsLen = 0;
+    if (length <= ats) {
+        return;
+    }
+
+    _atsLen = pn532_packetbuffer[ats];
+    if (_atsLen > length - ats) {
+        _atsLen = length - ats;
+    }
+    if (_atsLen > sizeof(_ats)) {
+        _atsLen = sizeof(_ats);
+    }
+    memcpy(_ats, pn532_packetbuffer + ats, _atsLen);
+}
+
 int8_t PN532::tgInitAsTarget(const uint8_t* command, const uint8_t len, const uint16_t timeout){
   
-  int8_t status = HAL(writeCommand)(command, len);
+  int8_t status = writeCommand(command, len);
     if (status < 0) {
         return -1;
     }
 
-    status = HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer), timeout);
+    status = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
     if (status > 0) {
         return 1;
     } else if (PN532_TIMEOUT == status) {
         return 0;
+    } else if (PN532_CANCELLED == status) {
+        return PN532_CANCELLED;
     } else {
         return -2;
     }
@@ -1235,11 +3707,11 @@ int16_t PN532::tgGetData(uint8_t *buf, uint8_t len)
 {
     buf[0] = PN532_COMMAND_TGGETDATA;
 
-    if (HAL(writeCommand)(buf, 1)) {
+    if (writeCommand(buf, 1)) {
         return -1;
     }
 
-    int16_t status = HAL(readResponse)(buf, len, 3000);
+    int16_t status = readResponse(buf, len, 3000);
     if (0 >= status) {
         return status;
     }
@@ -1247,7 +3719,7 @@ int16_t PN532::tgGetData(uint8_t *buf, uint8_t len)
     uint16_t length = status - 1;
 
 
-    if (buf[0] != 0) {
+    if (checkStatus(buf[0])) {
         DMSG("status is not ok\n");
         return -5;
     }
@@ -1261,14 +3733,14 @@ int16_t PN532::tgGetData(uint8_t *buf, uint8_t len)
 
 bool PN532::tgSetData(const uint8_t *header, uint8_t hlen, const uint8_t *body, uint8_t blen)
 {
-    if (hlen > (sizeof(pn532_packetbuffer) - 1)) {
+    if (hlen > (_packetBufferSize - 1)) {
         if ((body != 0) || (header == pn532_packetbuffer)) {
             DMSG("tgSetData:buffer too small\n");
             return false;
         }
 
         pn532_packetbuffer[0] = PN532_COMMAND_TGSETDATA;
-        if (HAL(writeCommand)(pn532_packetbuffer, 1, header, hlen)) {
+        if (writeCommand(pn532_packetbuffer, 1, header, hlen)) {
             return false;
         }
     } else {
@@ -1277,16 +3749,16 @@ bool PN532::tgSetData(const uint8_t *header, uint8_t hlen, const uint8_t *body,
         }
         pn532_packetbuffer[0] = PN532_COMMAND_TGSETDATA;
 
-        if (HAL(writeCommand)(pn532_packetbuffer, hlen + 1, body, blen)) {
+        if (writeCommand(pn532_packetbuffer, hlen + 1, body, blen)) {
             return false;
         }
     }
 
-    if (0 > HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer), 3000)) {
+    if (readResponse(pn532_packetbuffer, _packetBufferSize, 3000) < 1) {
         return false;
     }
 
-    if (0 != pn532_packetbuffer[0]) {
+    if (checkStatus(pn532_packetbuffer[0])) {
         return false;
     }
 
@@ -1295,15 +3767,172 @@ bool PN532::tgSetData(const uint8_t *header, uint8_t hlen, const uint8_t *body,
 
 int16_t PN532::inRelease(const uint8_t relevantTarget){
 
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+
     pn532_packetbuffer[0] = PN532_COMMAND_INRELEASE;
     pn532_packetbuffer[1] = relevantTarget;
 
-    if (HAL(writeCommand)(pn532_packetbuffer, 2)) {
+    if (writeCommand(pn532_packetbuffer, 2)) {
         return 0;
     }
 
     // read data packet
-    return HAL(readResponse)(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    return readResponse(pn532_packetbuffer, _packetBufferSize);
+}
+
+/**************************************************************************/
+/*!
+    Activates an NFC-DEP target (another PN532, a phone) as initiator
+
+    @param  active          1 for active mode, 0 for passive
+    @param  baudrate        PN532_BR_106, PN532_BR_212 or PN532_BR_424
+    @param  generalBytes    Gi sent in ATR_REQ, e.g. LLCP parameters
+    @param  generalBytesLength          Length of Gi, up to 48 bytes
+    @param  targetGeneralBytes          Receives Gt from ATR_RES, may be 0
+    @param  targetGeneralBytesLength    Size of targetGeneralBytes (in),
+                                        length of Gt (out)
+    @param  timeout         Time to wait for a target in ms
+
+    @returns 1 if a target was activated, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::inJumpForDEP(bool active, uint8_t baudrate, const uint8_t *generalBytes, uint8_t generalBytesLength,
+                         uint8_t *targetGeneralBytes, uint8_t *targetGeneralBytesLength, uint16_t timeout)
+{
+    pn532_packetbuffer[0] = PN532_COMMAND_INJUMPFORDEP;
+    pn532_packetbuffer[1] = active ? 0x01 : 0x00;
+    pn532_packetbuffer[2] = baudrate;
+    pn532_packetbuffer[3] = generalBytesLength ? 0x04 : 0x00;   // Next: Gi
+
+    uint8_t length = 4;
+    if (!active && PN532_BR_106 != baudrate) {
+        // Passive 212/424 kbps activation is a FeliCa polling for any system code
+        const uint8_t polling[] = { 0x00, 0xFF, 0xFF, 0x01, 0x00 };
+        pn532_packetbuffer[3] |= 0x01;                          // Next: PassiveInitiatorData
+        memcpy(pn532_packetbuffer + length, polling, sizeof(polling));
+        length += sizeof(polling);
+    }
+
+    if (writeCommand(pn532_packetbuffer, length, generalBytes, generalBytesLength)) {
+        return 0;
+    }
+
+    int16_t status = readResponse(pn532_packetbuffer, _packetBufferSize, timeout);
+    if (status < 1 || checkStatus(pn532_packetbuffer[0])) {
+        return 0;
+    }
+
+    /* InJumpForDEP response:
+
+      byte            Description
+      -------------   ------------------------------------------
+      b0              Status
+      b1              Tag Number
+      b2..11          NFCID3t
+      b12..16         DIDt, BSt, BRt, TO, PPt
+      b17..           Gt
+    */
+
+    _authSector = MIFARE_CLASSIC_NO_SECTOR;
+    _atsLen = 0;
+    _targetUidLen = 0;
+
+    if (status < 17) {
+        DMSG_STR("Invalid ATR_RES");
+        return 0;
+    }
+
+    inListedTag = pn532_packetbuffer[1];
+
+    if (targetGeneralBytes) {
+        uint8_t gtLength = status - 17;
+        if (gtLength > *targetGeneralBytesLength) {
+            gtLength = *targetGeneralBytesLength;
+        }
+        memcpy(targetGeneralBytes, pn532_packetbuffer + 17, gtLength);
+        *targetGeneralBytesLength = gtLength;
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Sends data to the NFC-DEP target activated by inJumpForDEP, the
+    first half of an InDataExchange; inGetData gets the answer.  The
+    PN532 splits the data in DEP frames (PFB MI bit) as the target needs.
+
+    @param  header  Data to send, may be in the buffer of getBuffer
+    @param  hlen    Length of header
+    @param  body    More data to send, after header
+    @param  blen    Length of body
+
+    @returns 1 if the PN532 accepted the command, 0 for an error
+*/
+/**************************************************************************/
+bool PN532::inSetData(const uint8_t *header, uint8_t hlen, const uint8_t *body, uint8_t blen)
+{
+    if (hlen > (_packetBufferSize - 2)) {
+        if ((body != 0) || (header == pn532_packetbuffer)) {
+            DMSG("inSetData:buffer too small\n");
+            return false;
+        }
+
+        pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+        pn532_packetbuffer[1] = inListedTag;
+        return 0 == writeCommand(pn532_packetbuffer, 2, header, hlen);
+    }
+
+    memmove(pn532_packetbuffer + 2, header, hlen);
+    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    pn532_packetbuffer[1] = inListedTag;
+
+    return 0 == writeCommand(pn532_packetbuffer, hlen + 2, body, blen);
+}
+
+/**************************************************************************/
+/*!
+    Gets the answer of the NFC-DEP target to inSetData.  An answer the
+    target chained (MI bit in the status) is fetched part by part and
+    put together in buf.
+
+    @param  buf     Buffer for the answer
+    @param  len     Size of buf
+    @param  timeout Time to wait for each part in ms
+
+    @returns Length of the answer, or < 0 for an error
+*/
+/**************************************************************************/
+int16_t PN532::inGetData(uint8_t *buf, uint8_t len, uint16_t timeout)
+{
+    uint8_t received = 0;
+
+    for (;;) {
+        int16_t status = readResponse(buf + received, len - received, timeout);
+        if (status < 1) {
+            return (status < 0) ? status : -1;
+        }
+
+        uint8_t flags = buf[received];
+        if (checkStatus(flags)) {
+            DMSG("status is not ok\n");
+            return -5;
+        }
+
+        memmove(buf + received, buf + received + 1, status - 1);
+        received += status - 1;
+
+        if (!(flags & PN532_MI_BIT)) {
+            return received;
+        }
+
+        // The target has more data: ask for the next part.  The command
+        // is built apart, buf may be the getBuffer() area
+        uint8_t next[2] = {PN532_COMMAND_INDATAEXCHANGE, inListedTag};
+        if (writeCommand(next, 2)) {
+            return -1;
+        }
+    }
 }
 
 
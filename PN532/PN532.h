@@ -51,6 +51,124 @@
 
 
 #define PN532_MIFARE_ISO14443A              (0x00)
+#define PN532_FELICA_212                    (0x01)
+#define PN532_FELICA_424                    (0x02)
+#define PN532_ISO14443B                     (0x03)
+#define PN532_JEWEL                         (0x04)
+
+// RFConfiguration items
+#define PN532_RF_ITEM_FIELD                 (0x01)
+#define PN532_RF_ITEM_TIMINGS               (0x02)
+#define PN532_RF_ITEM_MAXRTYCOM             (0x04)
+#define PN532_RF_ITEM_MAXRETRIES            (0x05)
+#define PN532_RF_ANALOG_106A                (0x0A)  // 11 bytes
+#define PN532_RF_ANALOG_212_424             (0x0B)  // 8 bytes
+#define PN532_RF_ANALOG_TYPEB               (0x0C)  // 3 bytes
+#define PN532_RF_ANALOG_ISO14443_4          (0x0D)  // 9 bytes, 212/424/848 kbps
+
+// RF field configuration bits
+#define PN532_RF_FIELD_ON                   (0x01)
+#define PN532_RF_FIELD_AUTO_RFCA            (0x02)
+
+// Timeouts of the timings item: 100 us * 2^(n - 1)
+#define PN532_RF_TIMEOUT_NONE               (0x00)
+#define PN532_RF_TIMEOUT_100US              (0x01)
+#define PN532_RF_TIMEOUT_200US              (0x02)
+#define PN532_RF_TIMEOUT_400US              (0x03)
+#define PN532_RF_TIMEOUT_800US              (0x04)
+#define PN532_RF_TIMEOUT_1_6MS              (0x05)
+#define PN532_RF_TIMEOUT_3_2MS              (0x06)
+#define PN532_RF_TIMEOUT_6_4MS              (0x07)
+#define PN532_RF_TIMEOUT_12_8MS             (0x08)
+#define PN532_RF_TIMEOUT_25_6MS             (0x09)
+#define PN532_RF_TIMEOUT_51_2MS             (0x0A)  // default of the retry timeout
+#define PN532_RF_TIMEOUT_102_4MS            (0x0B)  // default of the ATR_RES timeout
+#define PN532_RF_TIMEOUT_204_8MS            (0x0C)
+#define PN532_RF_TIMEOUT_409_6MS            (0x0D)
+#define PN532_RF_TIMEOUT_819_2MS            (0x0E)
+#define PN532_RF_TIMEOUT_1_64S              (0x0F)
+#define PN532_RF_TIMEOUT_3_28S              (0x10)
+
+#define PN532_RF_RETRY_FOREVER              (0xFF)
+
+// SetParameters flags
+#define PN532_PARAM_NAD_USED                (0x01)
+#define PN532_PARAM_DID_USED                (0x02)
+#define PN532_PARAM_AUTO_ATR_RES            (0x04)
+#define PN532_PARAM_AUTO_RATS               (0x10)
+#define PN532_PARAM_ISO14443_4_PICC         (0x20)
+#define PN532_PARAM_REMOVE_PRE_POSTAMBLE    (0x40)
+
+// Registers for ReadRegister / WriteRegister: SFRs of the 80C51 core
+#define PN532_REG_P3                        (0xFFB0)
+#define PN532_REG_P3CFGA                    (0xFFFC)
+#define PN532_REG_P3CFGB                    (0xFFFD)
+#define PN532_REG_P7                        (0xFFF7)
+#define PN532_REG_P7CFGA                    (0xFFF4)
+#define PN532_REG_P7CFGB                    (0xFFF5)
+
+// CIU (contactless interface unit) registers
+#define PN532_REG_CIU_MODE                  (0x6301)
+#define PN532_REG_CIU_TXMODE                (0x6302)
+#define PN532_REG_CIU_RXMODE                (0x6303)
+#define PN532_REG_CIU_TXCONTROL             (0x6304)
+#define PN532_REG_CIU_TXAUTO                (0x6305)
+#define PN532_REG_CIU_TXSEL                 (0x6306)
+#define PN532_REG_CIU_RXSEL                 (0x6307)
+#define PN532_REG_CIU_RXTHRESHOLD           (0x6308)
+#define PN532_REG_CIU_DEMOD                 (0x6309)
+#define PN532_REG_CIU_FELNFC1               (0x630A)
+#define PN532_REG_CIU_FELNFC2               (0x630B)
+#define PN532_REG_CIU_MIFNFC                (0x630C)
+#define PN532_REG_CIU_MANUALRCV             (0x630D)
+#define PN532_REG_CIU_TYPEB                 (0x630E)
+#define PN532_REG_CIU_CRCRESULTMSB          (0x6311)
+#define PN532_REG_CIU_CRCRESULTLSB          (0x6312)
+#define PN532_REG_CIU_GSNOFF                (0x6313)
+#define PN532_REG_CIU_MODWIDTH              (0x6314)
+#define PN532_REG_CIU_TXBITPHASE            (0x6315)
+#define PN532_REG_CIU_RFCFG                 (0x6316)    // receiver gain, RF level detector
+#define PN532_REG_CIU_GSNON                 (0x6317)    // driver conductance, field on
+#define PN532_REG_CIU_CWGSP                 (0x6318)
+#define PN532_REG_CIU_MODGSP                (0x6319)
+#define PN532_REG_CIU_TMODE                 (0x631A)
+#define PN532_REG_CIU_TPRESCALER            (0x631B)
+#define PN532_REG_CIU_TRELOADHI             (0x631C)
+#define PN532_REG_CIU_TRELOADLO             (0x631D)
+#define PN532_REG_CIU_TCOUNTERVALHI         (0x631E)
+#define PN532_REG_CIU_TCOUNTERVALLO         (0x631F)
+#define PN532_REG_CIU_TESTSEL1              (0x6321)
+#define PN532_REG_CIU_TESTSEL2              (0x6322)
+#define PN532_REG_CIU_TESTPINEN             (0x6323)
+#define PN532_REG_CIU_TESTPINVALUE          (0x6324)
+#define PN532_REG_CIU_TESTBUS               (0x6325)
+#define PN532_REG_CIU_AUTOTEST              (0x6326)
+#define PN532_REG_CIU_VERSION               (0x6327)
+#define PN532_REG_CIU_ANALOGTEST            (0x6328)
+#define PN532_REG_CIU_TESTDAC1              (0x6329)
+#define PN532_REG_CIU_TESTDAC2              (0x632A)
+#define PN532_REG_CIU_TESTADC               (0x632B)
+#define PN532_REG_CIU_RFLEVELDET            (0x632F)
+#define PN532_REG_CIU_COMMAND               (0x6331)
+#define PN532_REG_CIU_COMMIEN               (0x6332)
+#define PN532_REG_CIU_DIVIEN                (0x6333)
+#define PN532_REG_CIU_COMMIRQ               (0x6334)
+#define PN532_REG_CIU_DIVIRQ                (0x6335)
+#define PN532_REG_CIU_ERROR                 (0x6336)
+#define PN532_REG_CIU_STATUS1               (0x6337)
+#define PN532_REG_CIU_STATUS2               (0x6338)
+#define PN532_REG_CIU_FIFODATA              (0x6339)
+#define PN532_REG_CIU_FIFOLEVEL             (0x633A)
+#define PN532_REG_CIU_WATERLEVEL            (0x633B)
+#define PN532_REG_CIU_CONTROL               (0x633C)
+#define PN532_REG_CIU_BITFRAMING            (0x633D)
+#define PN532_REG_CIU_COLL                  (0x633E)
+
+// Bit rates of InPSL (BRit / BRti)
+#define PN532_BR_106                        (0x00)
+#define PN532_BR_212                        (0x01)
+#define PN532_BR_424                        (0x02)
+#define PN532_BR_848                        (0x03)
 
 // Mifare Commands
 #define MIFARE_CMD_AUTH_A                   (0x60)
@@ -63,9 +181,151 @@
 #define MIFARE_CMD_INCREMENT                (0xC1)
 #define MIFARE_CMD_STORE                    (0xC2)
 
+// Mifare Classic layout
+#define MIFARE_CLASSIC_BLOCK_SIZE           (16)
+#define MIFARE_CLASSIC_NO_SECTOR            (0xFF)  // no sector authenticated
+#define MIFARE_CLASSIC_NO_KEY               (0xFF)  // operation not allowed with any key
+#define MIFARE_CLASSIC_1K_SECTORS           (16)
+#define MIFARE_CLASSIC_4K_SECTORS           (40)
+
+// Mifare Classic access conditions: operations, and the permission bits
+// returned by mifareclassic_AccessPermissions (bit = 1 << (2 * op + key))
+// For a sector trailer, read/write apply to the access bits and keys.
+#define MIFARE_ACCESS_OP_READ               (0)
+#define MIFARE_ACCESS_OP_WRITE              (1)
+#define MIFARE_ACCESS_OP_INCREMENT          (2)
+#define MIFARE_ACCESS_OP_DECREMENT          (3)     // also transfer and restore
+#define MIFARE_ACCESS_READ_A                (0x01)
+#define MIFARE_ACCESS_READ_B                (0x02)
+#define MIFARE_ACCESS_WRITE_A               (0x04)
+#define MIFARE_ACCESS_WRITE_B               (0x08)
+#define MIFARE_ACCESS_INCREMENT_A           (0x10)
+#define MIFARE_ACCESS_INCREMENT_B           (0x20)
+#define MIFARE_ACCESS_DECREMENT_A           (0x40)
+#define MIFARE_ACCESS_DECREMENT_B           (0x80)
+
+// Timings and retries of the RF interface, see PN532::setRFConfig
+typedef struct {
+    uint8_t atrResTimeout;          // PN532_RF_TIMEOUT_xxx
+    uint8_t retryTimeout;           // PN532_RF_TIMEOUT_xxx, non-DEP exchanges
+    uint8_t maxRtyCOM;              // retries of InCommunicateThru / InDataExchange
+    uint8_t maxRtyATR;              // ATR_REQ retries
+    uint8_t maxRtyPSL;              // PSL_REQ retries
+    uint8_t maxRtyPassiveActivation;// InListPassiveTarget retries, 0xFF forever
+} pn532_rf_config_t;
+
+// One register and its value, see PN532::writeRegisters.  An array of
+// them is a tuning profile, or a snapshot to restore.
+typedef struct {
+    uint16_t address;       // PN532_REG_xxx
+    uint8_t value;
+} pn532_register_t;
+
+// Presets for setRFConfig
+extern const pn532_rf_config_t PN532_RF_DEFAULT;
+extern const pn532_rf_config_t PN532_RF_FAST_UID_POLL;
+extern const pn532_rf_config_t PN532_RF_ROBUST_LONG_RANGE;
+
+// An ISO14443A card found by PN532::inventoryPassiveTargets
+typedef struct {
+    uint8_t uid[10];
+    uint8_t uidLength;
+    uint8_t sak;            // SEL_RES, PN532_SAK_ISO14443_4 set for ISO-DEP cards
+    uint16_t atqa;          // SENS_RES
+} iso14443a_target_t;
+
+// One step of a batched Mifare Classic value block operation, see
+// mifareclassic_ValueBatch: command (MIFARE_CMD_INCREMENT, DECREMENT or
+// STORE for a restore) on block, then TRANSFER to transferBlock
+typedef struct {
+    uint8_t command;
+    uint8_t block;
+    uint32_t operand;       // ignored by MIFARE_CMD_STORE
+    uint8_t transferBlock;
+} mifareclassic_ValueOp;
+
+// Receives an NDEF message piece by piece from the streaming readers
+typedef void (*ndefSink)(const uint8_t *data, uint16_t length);
+// Fills buffer with up to length bytes of an NDEF message from offset on,
+// for the streaming writers; returns the number of bytes provided
+typedef uint16_t (*ndefSource)(uint8_t *buffer, uint16_t offset, uint16_t length);
+
 // NFC Forum Type 4
 #define TYPE4_MAPPING_MAJOR                 (0x2)
 #define TYPE4_MAPPING_MINOR                 (0x0)
+#define TYPE4_CC_SIZE                       (15)    // CC up to the NDEF File Control TLV
+
+// Capability Container of an NFC Forum Type 4 Tag, see type4_parse_cc
+typedef struct {
+    uint16_t mle;           // max data size of a READ BINARY response
+    uint16_t mlc;           // max data size of an UPDATE BINARY command
+    uint16_t fileId;        // NDEF file id
+    uint16_t maxNdefSize;   // NDEF file size, NLEN included
+    uint8_t readAccess;     // 0x00 = granted
+    uint8_t writeAccess;    // 0x00 = granted, 0xFF = denied
+} type4_cc_t;
+
+// ISO14443B
+#define ISO14443B_AFI_ANY                   (0x00)
+#define ISO14443B_ATTRIB_RES_SIZE           (8)     // longest ATTRIB_RES kept
+
+// An ISO14443B card found by PN532::iso14443b_Polling.  The PN532 sends
+// the ATTRIB itself (CID 0, its own frame size and 106 kbps); the card's
+// parameters for it are in protocolInfo.
+typedef struct {
+    uint8_t pupi[4];
+    uint8_t applicationData[4];
+    uint8_t protocolInfo[3];    // bit rates, max frame size, FWI...
+    uint8_t attribRes[ISO14443B_ATTRIB_RES_SIZE];
+    uint8_t attribResLength;
+} iso14443b_target_t;
+
+// Innovision Jewel / Topaz Commands (NFC Forum Type 1 Tag)
+#define JEWEL_CMD_RID                       (0x78)
+#define JEWEL_CMD_RALL                      (0x00)
+#define JEWEL_CMD_READ                      (0x01)
+#define JEWEL_CMD_WRITE_E                   (0x53)
+#define JEWEL_CMD_READ8                     (0x02)  // Topaz 512 only
+#define JEWEL_CMD_WRITE_E8                  (0x54)  // Topaz 512 only
+
+#define JEWEL_BLOCK_SIZE                    (8)
+#define JEWEL_RALL_SIZE                     (122)   // HR0 HR1 and blocks 0x0 to 0xE
+#define JEWEL_RALL_BUFFER_SIZE              (JEWEL_RALL_SIZE + 1)   // status byte included
+
+// FeliCa Commands
+#define FELICA_CMD_READ_WITHOUT_ENCRYPTION  (0x06)
+#define FELICA_CMD_WRITE_WITHOUT_ENCRYPTION (0x08)
+
+// FeliCa polling
+#define FELICA_SYSTEM_CODE_ANY              (0xFFFF)
+#define FELICA_REQUEST_NONE                 (0x00)
+#define FELICA_REQUEST_SYSTEM_CODE          (0x01)
+#define FELICA_REQUEST_COMMUNICATION        (0x02)  // communication performance
+
+#define FELICA_BLOCK_SIZE                   (16)
+#define FELICA_FRAME_SIZE                   (252)   // longest FeliCa frame in one PN532 frame
+
+// NFC Forum Type 3
+#define TYPE3_SYSTEM_CODE                   (0x12FC)
+#define TYPE3_SERVICE_READ                  (0x000B)
+#define TYPE3_SERVICE_WRITE                 (0x0009)
+#define TYPE3_MAPPING_MAJOR                 (0x1)
+#define TYPE3_WRITE_DONE                    (0x00)
+#define TYPE3_WRITE_IN_PROGRESS             (0x0F)
+#define TYPE3_READ_ONLY                     (0x00)
+#define TYPE3_READ_WRITE                    (0x01)
+
+// Attribute Information Block of an NFC Forum Type 3 Tag, see
+// type3_parse_attribute
+typedef struct {
+    uint8_t version;
+    uint8_t nbr;            // blocks per Read Without Encryption
+    uint8_t nbw;            // blocks per Write Without Encryption
+    uint16_t nmaxb;         // NDEF data blocks
+    uint8_t writeFlag;      // TYPE3_WRITE_DONE or TYPE3_WRITE_IN_PROGRESS
+    uint8_t rwFlag;         // TYPE3_READ_ONLY or TYPE3_READ_WRITE
+    uint32_t length;        // NDEF message length (Ln)
+} type3_attribute_t;
 
 // Prefixes for NDEF Records (to identify record type)
 #define NDEF_URIPREFIX_NONE                 (0x00)
@@ -105,6 +365,82 @@
 #define NDEF_URIPREFIX_URN_EPC              (0x22)
 #define NDEF_URIPREFIX_URN_NFC              (0x23)
 
+// Error codes in the status byte of the PN532 (status & PN532_ERROR_MASK)
+#define PN532_ERROR_MASK                    (0x3F)
+#define PN532_ERROR_NONE                    (0x00)
+#define PN532_ERROR_TIMEOUT                 (0x01)  // target didn't answer
+#define PN532_ERROR_CRC                     (0x02)
+#define PN532_ERROR_PARITY                  (0x03)
+#define PN532_ERROR_BIT_COUNT               (0x04)  // during anticollision
+#define PN532_ERROR_FRAMING                 (0x05)
+#define PN532_ERROR_COLLISION               (0x06)  // bit collision
+#define PN532_ERROR_BUFFER_SIZE             (0x07)  // communication buffer too small
+#define PN532_ERROR_RF_BUFFER_OVERFLOW      (0x09)
+#define PN532_ERROR_RF_FIELD                (0x0A)  // RF field not switched on in time
+#define PN532_ERROR_RF_PROTOCOL             (0x0B)
+#define PN532_ERROR_TEMPERATURE             (0x0D)  // antenna drivers overheated
+#define PN532_ERROR_INTERNAL_OVERFLOW       (0x0E)
+#define PN532_ERROR_INVALID_PARAMETER       (0x10)
+#define PN532_ERROR_DEP_COMMAND             (0x12)  // unsupported DEP command
+#define PN532_ERROR_DEP_FORMAT              (0x13)  // wrong data format or length
+#define PN532_ERROR_MIFARE_AUTH             (0x14)  // Mifare authentication error
+#define PN532_ERROR_UID_CHECK               (0x23)  // wrong UID check byte
+#define PN532_ERROR_DEP_STATE               (0x25)  // invalid device state
+#define PN532_ERROR_NOT_ALLOWED             (0x26)  // operation not allowed in this configuration
+#define PN532_ERROR_CONTEXT                 (0x27)  // command not acceptable in this context
+#define PN532_ERROR_RELEASED                (0x29)  // target released by the initiator
+#define PN532_ERROR_CARD_SWAPPED            (0x2A)  // different card in the field
+#define PN532_ERROR_CARD_GONE               (0x2B)  // card disappeared
+#define PN532_ERROR_NFCID3_MISMATCH         (0x2C)
+#define PN532_ERROR_OVERCURRENT             (0x2D)
+#define PN532_ERROR_NAD_MISSING             (0x2E)
+
+#define PN532_ATS_SIZE                      (20)   // longest ATS kept from activation
+#define PN532_SAK_ISO14443_4                (0x20) // SAK bit of ISO14443-4 compliant cards
+#define PN532_CASCADE_TAG                   (0x88) // CT before each cascade level of a long uid
+#define PN532_DIAGNOSE_PRESENCE             (0x06) // Diagnose test: ISO14443-4 card presence
+#define PN532_MI_BIT                        (0x40) // More Information, in Tg and Status
+
+// Size of the frame buffer inside each PN532, 64 to 255.  Larger sizes
+// allow longer responses (e.g. whole Type 4 chunks or FeliCa reads);
+// define it to 0 to have no buffer inside: every constructor must then
+// be given a buffer.  Set it as a compiler flag, so every file sees the
+// same.
+#ifndef PN532_PACKETBUFFER_SIZE
+#define PN532_PACKETBUFFER_SIZE             (64)
+#endif
+
+#define PN532_PACKETBUFFER_MIN              (64)
+
+#if PN532_PACKETBUFFER_SIZE > 255 || (PN532_PACKETBUFFER_SIZE > 0 && PN532_PACKETBUFFER_SIZE < PN532_PACKETBUFFER_MIN)
+#error "PN532_PACKETBUFFER_SIZE must be 0 or 64 to 255"
+#endif
+
+// Frame buffer arguments of the constructors, optional only when there
+// is a buffer inside
+#if PN532_PACKETBUFFER_SIZE > 0
+#define PN532_BUFFER_ARGS                   uint8_t *buffer = 0, uint8_t size = 0
+#else
+#define PN532_BUFFER_ARGS                   uint8_t *buffer, uint8_t size
+#endif
+
+// PN532_TRANSPORT: when a build uses a single transport, set it to its
+// class (e.g. -DPN532_TRANSPORT=PN532_SPI) and PN532 calls it without
+// virtual dispatch.  The constructors then take that class, so giving
+// them another transport fails to compile.  The header is <class>.h
+// unless PN532_TRANSPORT_HEADER names another one.
+#ifdef PN532_TRANSPORT
+#ifndef PN532_TRANSPORT_HEADER
+#define PN532_STRINGIFY(x)                  #x
+#define PN532_HEADER(name)                  PN532_STRINGIFY(name.h)
+#define PN532_TRANSPORT_HEADER              PN532_HEADER(PN532_TRANSPORT)
+#endif
+#include PN532_TRANSPORT_HEADER
+typedef PN532_TRANSPORT PN532Transport;
+#else
+typedef PN532Interface PN532Transport;
+#endif
+
 #define PN532_GPIO_VALIDATIONBIT            (0x80)
 #define PN532_GPIO_P30                      (0)
 #define PN532_GPIO_P31                      (1)
@@ -116,7 +452,17 @@
 class PN532
 {
 public:
-    PN532(PN532Interface &interface);
+    /**
+    * @param    interface   the transport
+    * @param    buffer      frame buffer owned by the caller, at least
+    *                       PN532_PACKETBUFFER_MIN bytes, 0 for the one of
+    *                       PN532_PACKETBUFFER_SIZE inside (required when
+    *                       there is none).  PN532 objects that are never
+    *                       used at the same time may share one.  A smaller
+    *                       buffer is not used.
+    * @param    size        size of buffer
+    */
+    PN532(PN532Transport &interface, PN532_BUFFER_ARGS);
 
     void begin(void);
 
@@ -126,12 +472,41 @@ public:
     bool writeGPIO(uint8_t pinstate);
     uint8_t readGPIO(void);
     bool setPassiveActivationRetries(uint8_t maxRetries);
+    bool setRFField(uint8_t field);
+    bool setTimings(uint8_t atrResTimeout, uint8_t retryTimeout);
+    bool setMaxRtyCOM(uint8_t maxRetries);
+    bool setMaxRetries(uint8_t maxRtyATR, uint8_t maxRtyPSL, uint8_t maxRtyPassiveActivation);
+    bool setAnalogSettings(uint8_t item, const uint8_t *settings);
+    bool setRFConfig(const pn532_rf_config_t *config);
+    bool setParameters(uint8_t flags);
+    bool readRegister(uint16_t address, uint8_t *value);
+    bool writeRegister(uint16_t address, uint8_t value);
+    bool readRegisters(const uint16_t *addresses, uint8_t count, uint8_t *values);
+    bool writeRegisters(const pn532_register_t *registers, uint8_t count);
+    bool snapshotRegisters(pn532_register_t *registers, uint8_t count);
+    bool restoreRegisters(const pn532_register_t *registers, uint8_t count) { return writeRegisters(registers, count); };
+
+    /**
+    * @brief    abort whatever command is waiting, e.g. tgInitAsTarget
+    *           without timeout, as soon as *cancel turns true.  Waits
+    *           end with PN532_CANCELLED; the flag is left set.
+    * @param    cancel  the flag, 0 for none
+    */
+    void setCancelFlag(volatile bool *cancel) { _interface->setCancelFlag(cancel); };
+
+    /**
+    * @brief    outcome of the last command sent: transport result
+    *           (PN532_TIMEOUT, PN532_INVALID_FRAME, ...) and PN532 error
+    *           code (PN532_ERROR_xxx), both 0 if it succeeded
+    */
+    pn532_status_t getStatus() { return _status; };
 
     /**
     * @brief    Init PN532 as a target
     * @param    timeout max time to wait, 0 means no timeout
     * @return   > 0     success
     *           = 0     timeout
+    *           PN532_CANCELLED  aborted with the cancel flag
     *           < 0     failed
     */
     int8_t tgInitAsTarget(uint16_t timeout = 0);
@@ -142,17 +517,64 @@ public:
 
     int16_t inRelease(const uint8_t relevantTarget = 0);
 
+    // NFC-DEP initiator functions
+    bool inJumpForDEP(bool active, uint8_t baudrate, const uint8_t *generalBytes = 0, uint8_t generalBytesLength = 0,
+                      uint8_t *targetGeneralBytes = 0, uint8_t *targetGeneralBytesLength = 0, uint16_t timeout = 1000);
+    bool inSetData(const uint8_t *header, uint8_t hlen, const uint8_t *body = 0, uint8_t blen = 0);
+    int16_t inGetData(uint8_t *buf, uint8_t len, uint16_t timeout = 3000);
+
     // ISO14443A functions
     bool inListPassiveTarget();
     bool readPassiveTargetID(uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout = 1000, bool inlist = false);
+    bool reselectPassiveTarget(const uint8_t *uid, uint8_t uidLength, uint16_t timeout = 100);
+    uint8_t inventoryPassiveTargets(iso14443a_target_t *targets, uint8_t maxTargets, uint16_t budget = 1000);
+    bool inPSL(uint8_t brIt, uint8_t brTi);
+    uint8_t boostBitRate(uint8_t maxRate = PN532_BR_848);
+    static void atsBitRates(const uint8_t *ats, uint8_t atsLength, uint8_t *brIt, uint8_t *brTi);
     bool inDataExchange(uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength);
+    int16_t inDataExchangeChained(const uint8_t *send, uint8_t sendLength, bool more, uint8_t *response, uint8_t responseSize, bool *moreData);
+    const uint8_t *getATS(uint8_t *length) { *length = _atsLen; return _ats; };
+    uint8_t getSAK() { return _sak; };
+    bool isTargetPresent();
+
+    // ISO14443B functions
+    bool iso14443b_Polling (uint8_t afi, iso14443b_target_t *target, uint16_t timeout = 1000);
+    static uint16_t iso14443b_MaxFrameSize (const iso14443b_target_t *target);
+
+    // Innovision Jewel / Topaz functions
+    bool jewel_Polling (uint8_t *uid, uint16_t timeout = 1000);
+    uint8_t jewel_ReadID (uint8_t *header, uint8_t *uid);
+    int16_t jewel_ReadAll (uint8_t *buffer);
+    uint8_t jewel_ReadByte (uint8_t address, uint8_t *data);
+    uint8_t jewel_WriteByte (uint8_t address, uint8_t data);
+    uint8_t jewel_ReadBlock (uint8_t block, uint8_t *data);
+    uint8_t jewel_WriteBlock (uint8_t block, const uint8_t *data);
 
     // Mifare Classic functions
     bool mifareclassic_IsFirstBlock (uint32_t uiBlock);
     bool mifareclassic_IsTrailerBlock (uint32_t uiBlock);
-    uint8_t mifareclassic_AuthenticateBlock (uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, uint8_t *keyData);
+    static uint8_t mifareclassic_BlockToSector (uint32_t uiBlock);
+    static uint8_t mifareclassic_SectorFirstBlock (uint8_t sectorNumber);
+    static uint8_t mifareclassic_SectorBlockCount (uint8_t sectorNumber);
+    static uint8_t mifareclassic_AccessGroup (uint32_t uiBlock);
+    static uint8_t mifareclassic_ParseAccessBits (const uint8_t *accessBits, uint8_t *conditions);
+    static void mifareclassic_BuildAccessBits (const uint8_t *conditions, uint8_t *accessBits);
+    static uint8_t mifareclassic_AccessPermissions (const uint8_t *conditions, uint8_t group);
+    static uint8_t mifareclassic_KeyForOperation (uint8_t permissions, uint8_t operation, uint8_t preferredKey = 0);
+    uint8_t mifareclassic_AuthenticateBlock (const uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, const uint8_t *keyData);
+    uint8_t mifareclassic_AuthenticateSector (const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t keyNumber, const uint8_t *keyData);
+    uint8_t mifareclassic_AuthenticatedSector (void) { return _authSector; };
+    void mifareclassic_ResetAuthentication (void) { _authSector = MIFARE_CLASSIC_NO_SECTOR; };
     uint8_t mifareclassic_ReadDataBlock (uint8_t blockNumber, uint8_t *data);
+    uint8_t mifareclassic_ReadSector (const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t keyNumber, const uint8_t *keyData, uint8_t *data);
     uint8_t mifareclassic_WriteDataBlock (uint8_t blockNumber, uint8_t *data);
+    uint8_t mifareclassic_FormatValueBlock (uint8_t blockNumber, int32_t value, uint8_t address);
+    uint8_t mifareclassic_ReadValueBlock (uint8_t blockNumber, int32_t *value, uint8_t *address = 0);
+    uint8_t mifareclassic_IncrementValueBlock (uint8_t blockNumber, uint32_t delta);
+    uint8_t mifareclassic_DecrementValueBlock (uint8_t blockNumber, uint32_t delta);
+    uint8_t mifareclassic_RestoreValueBlock (uint8_t blockNumber);
+    uint8_t mifareclassic_TransferValueBlock (uint8_t blockNumber);
+    uint8_t mifareclassic_ValueBatch (const mifareclassic_ValueOp *ops, uint8_t count);
     uint8_t mifareclassic_FormatNDEF (void);
     uint8_t mifareclassic_WriteNDEFURI (uint8_t sectorNumber, uint8_t uriIdentifier, const char *url);
 
@@ -164,30 +586,88 @@ public:
     uint8_t type4_select_ndef_application ();
     uint8_t type4_select_cc ();
     uint8_t type4_select_ndef (uint16_t file_id);
-    uint8_t type4_read_cc (uint16_t *length, uint8_t *buffer);
-    uint8_t type4_read_ndef (uint16_t *length, uint8_t *buffer);
+    uint8_t type4_read_cc (uint16_t *length, uint8_t *buffer, uint8_t size);
+    uint8_t type4_read_ndef (uint16_t *length, uint8_t *buffer, uint16_t size);
+    int16_t type4_read_binary (uint16_t offset, uint8_t le, uint8_t *buffer);
+    uint8_t type4_update_binary (uint16_t offset, const uint8_t *data, uint8_t lc);
+    static uint8_t type4_parse_cc (const uint8_t *cc, type4_cc_t *params);
     uint8_t type4_write_ndef (uint8_t length, uint8_t *data);
-    uint8_t type4_ReadFile (uint8_t *length, uint8_t *buffer);
+    uint8_t type4_ReadFile (uint16_t *length, uint8_t *buffer, uint16_t size);
     uint8_t type4_WriteFile (uint8_t length, uint8_t *buffer);
+    uint8_t type4_ReadNDEF (ndefSink sink, uint16_t *length);
+    uint8_t type4_WriteNDEF (ndefSource source, uint16_t length);
+
+    // FeliCa functions
+    uint8_t felica_Polling (uint16_t systemCode, uint8_t requestCode, uint8_t *idm, uint8_t *pmm, uint16_t *systemCodeResponse,
+                            uint8_t baudrate = PN532_FELICA_212, uint16_t timeout = 1000);
+    uint8_t felica_ReadWithoutEncryption (uint16_t serviceCode, uint16_t firstBlock, uint16_t count, uint8_t *data, uint8_t maxBlocks = 0);
+    uint8_t felica_WriteWithoutEncryption (uint16_t serviceCode, uint16_t firstBlock, uint16_t count, const uint8_t *data, uint8_t maxBlocks = 0);
+    uint8_t felica_ReadBlocksMax () { return (_packetBufferSize - 14) / FELICA_BLOCK_SIZE; };
+    uint16_t felica_StatusFlags () { return _felicaStatus; };
+
+    // NFC Forum Type 3 Tag
+    static uint8_t type3_parse_attribute (const uint8_t *block, type3_attribute_t *attribute);
+    static void type3_build_attribute (const type3_attribute_t *attribute, uint8_t *block);
+    uint8_t type3_read_attribute (type3_attribute_t *attribute);
+    uint8_t type3_ReadNDEF (ndefSink sink, uint16_t *length);
+    uint8_t type3_WriteNDEF (ndefSource source, uint16_t length);
 
     // Help functions to display formatted text
     static void PrintHex(const uint8_t *data, const uint32_t numBytes);
     static void PrintHexChar(const uint8_t *pbtData, const uint32_t numBytes);
 
     uint8_t *getBuffer(uint8_t *len) {
-        *len = sizeof(pn532_packetbuffer) - 4;
+        *len = _packetBufferSize - 4;
         return pn532_packetbuffer;
     };
 
 private:
-    uint8_t _uid[7];  // ISO14443A uid
+    uint8_t mifareclassic_ValueCommand (uint8_t command, uint8_t blockNumber, uint32_t operand);
+    void recordTarget (int16_t length);
+    int8_t writeCommand (const uint8_t *header, uint8_t hlen, const uint8_t *body = 0, uint8_t blen = 0);
+    int16_t readResponse (uint8_t buf[], uint8_t len, uint16_t timeout = 1000);
+    uint8_t checkStatus (uint8_t status);
+    bool rfConfiguration (uint8_t item, const uint8_t *data, uint8_t length);
+    bool readRegisterBatch (uint8_t count);
+    bool haltTarget (uint8_t tg, bool iso14443_4);
+
+    uint8_t _uid[10]; // ISO14443A uid
     uint8_t _uidLen;  // uid len
     uint8_t _key[6];  // Mifare Classic key
+    uint8_t _ats[PN532_ATS_SIZE];  // ATS of the last ISO14443-4A target, TL included
+    uint8_t _atsLen;               // 0 if the target isn't ISO14443-4 compliant
+    uint8_t _sak;                  // SEL_RES of the last ISO14443A target
+    uint8_t _targetUid[10];        // uid of the last ISO14443A target
+    uint8_t _targetUidLen;         // 0 if there is no ISO14443A target
+    uint8_t _authSector;    // sector authenticated with _key, or MIFARE_CLASSIC_NO_SECTOR
+    uint8_t _authKeyNumber; // key type used for _authSector (0 = A, 1 = B)
     uint8_t inListedTag; // Tg number of inlisted tag.
+    uint16_t _type4Mle;  // MLe of the Type 4 Tag, 0 until its CC is read
+    uint16_t _type4Mlc;  // MLc of the Type 4 Tag, 0 until its CC is read
+    uint8_t _jewelUid[4];    // UID of the last Jewel / Topaz target
+    uint8_t _felicaIDm[8];   // IDm of the last FeliCa target
+    uint16_t _felicaStatus;  // status flags of the last FeliCa command, SF1 SF2
 
-    uint8_t pn532_packetbuffer[64];
+    uint8_t type4_chunk_size ();
+    uint8_t type4_update_chunk_size ();
+    uint8_t type4_write_ndef_stream (ndefSource source, const uint8_t *data, uint16_t length);
+
+    int16_t jewel_Command (uint8_t command, uint8_t address, const uint8_t *data, uint8_t dataLength,
+                           uint8_t *response, uint8_t responseSize);
+    uint8_t felica_BlockCommand (uint8_t code, uint16_t serviceCode, uint16_t firstBlock, uint8_t count);
+    uint8_t felica_Exchange (uint8_t length, const uint8_t *body = 0, uint8_t bodyLength = 0);
+    uint8_t felica_ReadChunk (uint16_t serviceCode, uint16_t firstBlock, uint8_t count);
+    static uint8_t felica_WriteBlocksMax (uint16_t firstBlock, uint16_t count, uint8_t room, uint8_t maxBlocks);
+    uint8_t type3_write_attribute (const type3_attribute_t *attribute);
+
+    uint8_t *pn532_packetbuffer;
+    uint8_t _packetBufferSize;
+#if PN532_PACKETBUFFER_SIZE > 0
+    uint8_t _packetBuffer[PN532_PACKETBUFFER_SIZE];
+#endif
 
-    PN532Interface *_interface;
+    PN532Transport *_interface;
+    pn532_status_t _status;
 };
 
 #endif
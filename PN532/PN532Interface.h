@@ -19,6 +19,14 @@
 #define PN532_TIMEOUT                 (-2)
 #define PN532_INVALID_FRAME           (-3)
 #define PN532_NO_SPACE                (-4)
+#define PN532_CANCELLED               (-6)
+
+// Outcome of the last command: transport result (0 or one of the codes
+// above) and error code of the PN532 status byte (PN532_ERROR_xxx)
+typedef struct {
+    int8_t transport;
+    uint8_t error;
+} pn532_status_t;
 
 #define REVERSE_BITS_ORDER(b)         b = (b & 0xF0) >> 4 | (b & 0x0F) << 4; \
                                       b = (b & 0xCC) >> 2 | (b & 0x33) << 2; \
@@ -27,6 +35,8 @@
 class PN532Interface
 {
 public:
+    PN532Interface() : _cancel(0) {}
+
     virtual void begin() = 0;
     virtual void wakeup() = 0;
 
@@ -50,6 +60,20 @@ public:
     *           <0      failed to read response
     */
     virtual int16_t readResponse(uint8_t buf[], uint8_t len, uint16_t timeout = 1000) = 0;
+
+    /**
+    * @brief    set a flag checked while waiting for a response.  Once it
+    *           is true, the pending command is aborted with an ACK frame
+    *           and readResponse returns PN532_CANCELLED.  The flag is
+    *           left set, the caller clears it.
+    * @param    cancel  the flag, e.g. set from an interrupt, 0 for none
+    */
+    virtual void setCancelFlag(volatile bool *cancel) { _cancel = cancel; }
+
+protected:
+    volatile bool *_cancel;
+
+    bool cancelled() { return _cancel && *_cancel; }
 };
 
 #endif
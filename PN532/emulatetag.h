@@ -19,7 +19,7 @@ typedef enum {COMMAND_COMPLETE, TAG_NOT_FOUND, FUNCTION_NOT_SUPPORTED, MEMORY_FA
 class EmulateTag{
 
 public:
-EmulateTag(PN532Interface &interface) : pn532(interface), uidPtr(0), tagWrittenByInitiator(false), tagWriteable(true), updateNdefCallback(0) { }
+EmulateTag(PN532Transport &interface, PN532_BUFFER_ARGS) : pn532(interface, buffer, size), uidPtr(0), tagWrittenByInitiator(false), tagWriteable(true), updateNdefCallback(0) { }
   
   bool init();
 
@@ -57,6 +57,11 @@ EmulateTag(PN532Interface &interface) : pn532(interface), uidPtr(0), tagWrittenB
     updateNdefCallback = func;
   };
 
+  // outcome of the last PN532 command, see PN532::getStatus
+  pn532_status_t getStatus(){
+    return pn532.getStatus();
+  }
+
 private:
   PN532 pn532;
   uint8_t ndef_file[NDEF_MAX_LENGTH];
@@ -2,9 +2,11 @@
 #include <PN532_SPI.h>
 #include <PN532Interface.h>
 #include <PN532.h>
+#include <iso7816.h>
 
 PN532_SPI pn532spi(SPI, 10);
 PN532 nfc(pn532spi);
+ISO7816 iso(nfc);
 
 
 void setup()
@@ -38,8 +40,6 @@ void loop()
 {
   bool success;
   
-  uint8_t responseLength = 32;
-  
   Serial.println("Waiting for an ISO14443A card");
   
   // set shield to inListPassiveTarget
@@ -49,23 +49,25 @@ void loop()
    
      Serial.println("Found something!");
                   
-    uint8_t selectApdu[] = { 0x00, /* CLA */
-                              0xA4, /* INS */
-                              0x04, /* P1  */
-                              0x00, /* P2  */
-                              0x07, /* Length of AID  */
-                              0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, /* AID defined on Android App */
-                              0x00  /* Le  */ };
+    const uint8_t aid[] = { 0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 }; /* AID defined on Android App */
+    iso7816_command_t selectApdu = { 0x00, /* CLA */
+                                     0xA4, /* INS */
+                                     0x04, /* P1  */
+                                     0x00, /* P2  */
+                                     aid, sizeof(aid),
+                                     ISO7816_SHORT_LE };
                               
-    uint8_t response[32];  
+    uint8_t response[32];
+    iso7816_response_t selectResponse = { response, sizeof(response) };
      
-    success = nfc.inDataExchange(selectApdu, sizeof(selectApdu), response, &responseLength);
+    iso.begin();
+    success = iso.transceive(&selectApdu, &selectResponse) && selectResponse.sw == ISO7816_SW_OK;
     
     if(success) {
       
-      Serial.print("responseLength: "); Serial.println(responseLength);
+      Serial.print("responseLength: "); Serial.println(selectResponse.length);
        
-      nfc.PrintHexChar(response, responseLength);
+      nfc.PrintHexChar(response, selectResponse.length);
       
       do {
         uint8_t apdu[] = "Hello from Arduino";
@@ -0,0 +1,85 @@
+/**************************************************************************/
+/*!
+    This example polls for a FeliCa card (NFC Forum Type 3 Tag), prints
+    its NDEF message, then reads the NDEF data blocks once per command
+    and packed, as many per command as the tag (Nbr) and the PN532
+    buffer allow, and reports blocks/sec for both.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+
+#define BLOCKS 12
+
+void sink(const uint8_t *data, uint16_t length)
+{
+  Serial.write(data, length);
+}
+
+void benchmark(uint16_t blocks, uint8_t perCommand)
+{
+  uint8_t data[BLOCKS * FELICA_BLOCK_SIZE];
+
+  unsigned long start = micros();
+  if (!nfc.felica_ReadWithoutEncryption(TYPE3_SERVICE_READ, 1, blocks, data, perCommand)) {
+    Serial.println("Read failed");
+    return;
+  }
+  unsigned long elapsed = micros() - start;
+
+  Serial.print(perCommand); Serial.print(" block(s) per command: ");
+  Serial.print(blocks * 1000000.0 / elapsed); Serial.println(" blocks/sec");
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  Serial.println("Waiting for a FeliCa card ...");
+}
+
+void loop(void) {
+  uint8_t idm[8];
+  uint16_t systemCode;
+  uint16_t length;
+  type3_attribute_t attribute;
+
+  if (!nfc.felica_Polling(TYPE3_SYSTEM_CODE, FELICA_REQUEST_SYSTEM_CODE, idm, 0, &systemCode, PN532_FELICA_212)) {
+    return;
+  }
+
+  Serial.print("IDm: "); nfc.PrintHex(idm, 8);
+
+  if (nfc.type3_ReadNDEF(sink, &length) && nfc.type3_read_attribute(&attribute)) {
+    Serial.println();
+
+    uint16_t blocks = attribute.nmaxb < BLOCKS ? attribute.nmaxb : BLOCKS;
+    uint8_t packed = attribute.nbr < nfc.felica_ReadBlocksMax() ? attribute.nbr : nfc.felica_ReadBlocksMax();
+
+    benchmark(blocks, 1);
+    benchmark(blocks, packed);
+  } else {
+    Serial.println("Not an NFC Forum Type 3 Tag");
+  }
+
+  nfc.inRelease();
+  delay(1000);
+}
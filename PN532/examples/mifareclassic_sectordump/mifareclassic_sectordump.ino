@@ -0,0 +1,100 @@
+/**************************************************************************/
+/*!
+    This example dumps a Mifare Classic 1K card twice and compares the
+    time taken by:
+
+    1. authenticating before every block, then reading it
+    2. mifareclassic_ReadSector, which authenticates once per sector
+       (about 16 authentications instead of 64)
+
+    Both dumps use key B 0xFF 0xFF 0xFF 0xFF 0xFF 0xFF.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+
+uint8_t keyuniversal[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  Serial.println("Waiting for a Mifare Classic 1K card ...");
+}
+
+void loop(void) {
+  uint8_t uid[] = { 0, 0, 0, 0, 0, 0, 0 };
+  uint8_t uidLength;
+  uint8_t data[64];
+  uint16_t auths;
+  uint8_t errors;
+  unsigned long start;
+
+  if (!nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength) || uidLength != 4) {
+    return;
+  }
+
+  // 1. one authentication per block
+  auths = 0;
+  errors = 0;
+  start = millis();
+  for (uint8_t block = 0; block < 64; block++) {
+    auths++;
+    if (!nfc.mifareclassic_AuthenticateBlock(uid, uidLength, block, 1, keyuniversal) ||
+        !nfc.mifareclassic_ReadDataBlock(block, data)) {
+      errors++;
+      // re-select the card, it is halted after an error
+      nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength);
+    }
+  }
+  Serial.print("Per block:  "); Serial.print(millis() - start); Serial.print(" ms, ");
+  Serial.print(auths); Serial.print(" auths, "); Serial.print(errors); Serial.println(" errors");
+
+  // 2. one authentication per sector
+  nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength);
+  auths = 0;
+  errors = 0;
+  start = millis();
+  for (uint8_t sector = 0; sector < 16; sector++) {
+    if (nfc.mifareclassic_AuthenticatedSector() != sector) {
+      auths++;
+    }
+    if (!nfc.mifareclassic_ReadSector(uid, uidLength, sector, 1, keyuniversal, data)) {
+      errors++;
+      nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength);
+    }
+  }
+  Serial.print("Per sector: "); Serial.print(millis() - start); Serial.print(" ms, ");
+  Serial.print(auths); Serial.print(" auths, "); Serial.print(errors); Serial.println(" errors");
+
+  // print the last sector as a sanity check
+  for (uint8_t i = 0; i < 4; i++) {
+    nfc.PrintHexChar(data + i * 16, 16);
+  }
+
+  Serial.println("\n\nSend a character to run the benchmark again!");
+  Serial.flush();
+  while (!Serial.available());
+  while (Serial.available()) {
+    Serial.read();
+  }
+  Serial.flush();
+}
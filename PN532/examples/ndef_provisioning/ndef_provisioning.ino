@@ -0,0 +1,92 @@
+/**************************************************************************/
+/*!
+    This example writes the same NDEF message (a URI) onto every NTAG21x,
+    Mifare Ultralight or Mifare Classic tag put on the reader, and prints
+    the production rate and the time spent in each step.
+
+    Set LOCK_TAGS to 1 to make the tags read-only: this can't be undone.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+#include "mifareclassic_keys.h"
+#include "provisioner.h"
+
+#define LOCK_TAGS 0
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+
+// Transport key, then the NDEF and MAD keys of cards provisioned before
+const uint8_t keys[][6] = {
+  {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
+  {0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7},
+  {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5},
+};
+MifareClassicKeys classicKeys(nfc, keys, 3);
+Provisioner provisioner(nfc, classicKeys);
+
+// URI record "https://www.seeedstudio.com"
+const uint8_t message[] = {
+  0xD1, 0x01, 0x10, 'U', 0x02,
+  's', 'e', 'e', 'e', 'd', 's', 't', 'u', 'd', 'i', 'o', '.', 'c', 'o', 'm'
+};
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  if (!provisioner.begin(message, sizeof(message), LOCK_TAGS)) {
+    Serial.println("Message too large");
+    while (1); // halt
+  }
+
+  Serial.println("Put the tags on the reader one after the other");
+}
+
+void loop(void) {
+  uint8_t result = provisioner.poll();
+  if (result == PROVISION_NO_TAG) {
+    return;
+  }
+
+  const provisioner_stats_t &stats = provisioner.stats();
+
+  if (result == PROVISION_OK) {
+    Serial.print("OK    ");
+  } else if (result == PROVISION_UNSUPPORTED) {
+    Serial.print("UNSUPPORTED ");
+  } else {
+    Serial.print("FAILED ");
+  }
+  Serial.print(stats.tags);
+  Serial.print(" tags, ");
+  Serial.print(provisioner.tagsPerMinute());
+  Serial.println(" tags/min");
+
+  if (stats.tags) {
+    Serial.print("  ms per tag: detect ");
+    Serial.print(stats.detectTime / stats.tags);
+    Serial.print(", write ");
+    Serial.print(stats.writeTime / stats.tags);
+    Serial.print(", verify ");
+    Serial.print(stats.verifyTime / stats.tags);
+    Serial.print(", lock ");
+    Serial.println(stats.lockTime / stats.tags);
+  }
+}
@@ -0,0 +1,55 @@
+/**************************************************************************/
+/*!
+    This example reports ISO14443A cards as they arrive on and leave the
+    reader.  A tap gives one "arrived" and one "departed" event however
+    long the card stays, so heavy work (reading, writing) runs once.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+#include "tag_events.h"
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+TagEvents events(nfc, 200);     // a card unseen for 200 ms is gone
+
+void onTag(uint8_t event, const uint8_t *uid, uint8_t uidLength)
+{
+  if (event == TAG_EVENT_PRESENT) {
+    return;
+  }
+
+  Serial.print(event == TAG_EVENT_ARRIVED ? "Arrived: " : "Departed: ");
+  nfc.PrintHex(uid, uidLength);
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  // give up quickly when no card is in the field
+  nfc.setRFConfig(&PN532_RF_FAST_UID_POLL);
+
+  events.attach(onTag);
+
+  Serial.println("Waiting for an ISO14443A card");
+}
+
+void loop(void) {
+  events.poll();
+}
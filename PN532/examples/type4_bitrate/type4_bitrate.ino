@@ -0,0 +1,83 @@
+/**************************************************************************/
+/*!
+    This example reads the NDEF message of an NFC Forum Type 4 Tag twice,
+    at 106 kbps and after switching to the highest bit rate the card
+    supports (InPSL), and reports both read times.  Use a multi-KB
+    message to see the effect.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+
+const char *rates[] = { "106", "212", "424", "848" };
+
+void sink(const uint8_t *data, uint16_t length)
+{
+  // only the time matters here
+}
+
+unsigned long timedRead(uint16_t *length)
+{
+  unsigned long start = millis();
+
+  if (!nfc.type4_ReadNDEF(sink, length)) {
+    return 0;
+  }
+  return millis() - start;
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  Serial.println("Waiting for a Type 4 Tag ...");
+}
+
+void loop(void) {
+  uint16_t length;
+
+  if (!nfc.inListPassiveTarget()) {
+    return;
+  }
+
+  unsigned long slow = timedRead(&length);
+  if (!slow) {
+    Serial.println("Failed to read the NDEF message");
+    nfc.inRelease();
+    delay(1000);
+    return;
+  }
+
+  uint8_t rate = nfc.boostBitRate();
+  unsigned long fast = timedRead(&length);
+
+  Serial.print("NDEF message: "); Serial.print(length); Serial.println(" bytes");
+  Serial.print("106 kbps: "); Serial.print(slow); Serial.println(" ms");
+  Serial.print(rates[rate]); Serial.print(" kbps: ");
+  if (fast) {
+    Serial.print(fast); Serial.println(" ms");
+  } else {
+    Serial.println("read failed");
+  }
+
+  nfc.inRelease();
+  delay(1000);
+}
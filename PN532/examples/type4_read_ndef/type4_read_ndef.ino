@@ -0,0 +1,77 @@
+/**************************************************************************/
+/*!
+    This example streams the NDEF message of an NFC Forum Type 4 Tag
+    (e.g. a DESFire card or an Android phone in HCE mode) and reports the
+    read throughput.  The message is never held in memory as a whole, so
+    multi-KB messages can be read on small boards.
+
+    To enable debug message, define DEBUG in PN532/PN532_debug.h
+*/
+/**************************************************************************/
+
+#include <SPI.h>
+#include <PN532_SPI.h>
+#include "PN532.h"
+
+PN532_SPI pn532spi(SPI, 10);
+PN532 nfc(pn532spi);
+
+uint32_t received;
+uint16_t chunks;
+
+void sink(const uint8_t *data, uint16_t length)
+{
+  // print the beginning of the message only, printing is slow
+  if (received == 0) {
+    nfc.PrintHexChar(data, length);
+  }
+  received += length;
+  chunks++;
+}
+
+void setup(void) {
+  Serial.begin(115200);
+  Serial.println("Looking for PN532...");
+
+  nfc.begin();
+
+  uint32_t versiondata = nfc.getFirmwareVersion();
+  if (! versiondata) {
+    Serial.print("Didn't find PN53x board");
+    while (1); // halt
+  }
+
+  // configure board to read RFID tags
+  nfc.SAMConfig();
+
+  Serial.println("Waiting for a Type 4 Tag ...");
+}
+
+void loop(void) {
+  uint16_t length;
+
+  if (!nfc.inListPassiveTarget()) {
+    return;
+  }
+
+  received = 0;
+  chunks = 0;
+  unsigned long start = millis();
+
+  if (nfc.type4_ReadNDEF(sink, &length)) {
+    unsigned long elapsed = millis() - start;
+    Serial.print("NDEF message: "); Serial.print(length); Serial.println(" bytes");
+    Serial.print("Read in "); Serial.print(elapsed); Serial.print(" ms, ");
+    Serial.print(chunks); Serial.print(" READ BINARY, ");
+    if (elapsed) {
+      Serial.print(received * 1000 / elapsed); Serial.println(" bytes/s");
+    } else {
+      Serial.println("");
+    }
+  } else {
+    Serial.println("Failed to read the NDEF message");
+  }
+
+  nfc.inRelease();
+  delay(1000);
+}
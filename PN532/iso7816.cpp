@@ -0,0 +1,229 @@
+
+#include "iso7816.h"
+#include "PN532_debug.h"
+#include <string.h>
+
+ISO7816::ISO7816(PN532 &nfc)
+{
+    _nfc = &nfc;
+    _extended = false;
+    _exchanges = 0;
+}
+
+uint8_t ISO7816::begin()
+{
+    uint8_t atsLength;
+    const uint8_t *ats = _nfc->getATS(&atsLength);
+    uint8_t capabilities = parseCapabilities(ats, atsLength);
+
+    _extended = capabilities & ISO7816_CAP_EXTENDED;
+
+    return capabilities;
+}
+
+/**************************************************************************/
+/*!
+    Finds the card capabilities (compact-TLV tag 7) in the historical
+    bytes of an ATS
+
+    @param  ats         The ATS, TL included
+    @param  atsLength   Length of the ATS
+
+    @returns ISO7816_CAP_* flags, 0 if the card doesn't tell
+*/
+/**************************************************************************/
+uint8_t ISO7816::parseCapabilities(const uint8_t *ats, uint8_t atsLength)
+{
+    if (atsLength < 2) {
+        return 0;
+    }
+    if (atsLength > ats[0]) {
+        atsLength = ats[0];
+    }
+
+    // Skip TL, T0 and the interface bytes TA(1), TB(1), TC(1) announced by T0
+    uint8_t i = 2;
+    for (uint8_t mask = 0x10; mask <= 0x40; mask <<= 1) {
+        if (ats[1] & mask) {
+            i++;
+        }
+    }
+
+    // Category indicator 0x00 ends with a 3 bytes status, 0x80 doesn't
+    if (i < atsLength && 0x00 == ats[i] && atsLength - i > 3) {
+        atsLength -= 3;
+    } else if (i >= atsLength || 0x80 != ats[i]) {
+        return 0;
+    }
+
+    for (i++; i < atsLength; i += 1 + (ats[i] & 0x0F)) {
+        if (0x70 == (ats[i] & 0xF0) && (ats[i] & 0x0F) >= 3 && i + 3 < atsLength) {
+            return ats[i + 3] & (ISO7816_CAP_CHAINING | ISO7816_CAP_EXTENDED);
+        }
+    }
+
+    return 0;
+}
+
+uint8_t ISO7816::transceive(const iso7816_command_t *command, iso7816_response_t *response)
+{
+    const uint8_t *data = command->data;
+    uint16_t lc = command->lc;
+
+    response->length = 0;
+    response->sw = 0;
+
+    // Command chaining, when Lc doesn't fit a short APDU
+    while (lc > ISO7816_SHORT_LC && !_extended) {
+        if (!send(command, data, ISO7816_SHORT_LC, command->cla | ISO7816_CLA_CHAINING, 0, response)) {
+            return 0;
+        }
+        if (response->sw != ISO7816_SW_OK) {
+            DMSG_STR("Command chaining refused");
+            return 1;
+        }
+        response->length = 0;
+        data += ISO7816_SHORT_LC;
+        lc -= ISO7816_SHORT_LC;
+    }
+
+    if (!send(command, data, lc, command->cla, command->le, response)) {
+        return 0;
+    }
+
+    if (ISO7816_SW1_WRONG_LE == response->sw >> 8) {
+        uint16_t le = response->sw & 0xFF;
+
+        response->length = 0;
+        if (!send(command, data, lc, command->cla, le ? le : ISO7816_SHORT_LE, response)) {
+            return 0;
+        }
+    }
+
+    while (ISO7816_SW1_MORE_DATA == response->sw >> 8) {
+        iso7816_command_t getResponse = {
+            (uint8_t)(command->cla & ~ISO7816_CLA_CHAINING), ISO7816_INS_GET_RESPONSE, 0x00, 0x00,
+            0, 0, (uint16_t)(response->sw & 0xFF)
+        };
+
+        if (!getResponse.le) {
+            getResponse.le = ISO7816_SHORT_LE;
+        }
+        if (!send(&getResponse, 0, 0, getResponse.cla, getResponse.le, response)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Sends one APDU, short or extended, and appends the data received
+    to the response
+*/
+/**************************************************************************/
+uint8_t ISO7816::send(const iso7816_command_t *command, const uint8_t *data, uint16_t lc, uint8_t cla,
+                      uint16_t le, iso7816_response_t *response)
+{
+    uint8_t head[7] = {cla, command->ins, command->p1, command->p2};
+    uint8_t headLength = 4;
+    uint8_t tail[3];
+    uint8_t tailLength = 0;
+    bool extended = _extended && (lc > ISO7816_SHORT_LC || le > ISO7816_SHORT_LE);
+
+    if (lc) {
+        if (extended) {
+            head[headLength++] = 0x00;
+            head[headLength++] = lc >> 8;
+        }
+        head[headLength++] = lc & 0xFF;
+    }
+
+    if (le) {
+        if (extended) {
+            if (!lc) {
+                tail[tailLength++] = 0x00;
+            }
+            tail[tailLength++] = le >> 8;
+        }
+        tail[tailLength++] = (le >= ISO7816_SHORT_LE && !extended) ? 0x00 : le & 0xFF;
+    }
+
+    uint8_t *buffer = response->data + response->length;
+    int16_t length = exchange(head, headLength, data, lc, tail, tailLength, buffer, response->size - response->length);
+    if (length < 2) {
+        DMSG_STR("No status word");
+        return 0;
+    }
+
+    response->length += length - 2;
+    response->sw = buffer[length - 2] << 8 | buffer[length - 1];
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Sends head, data and tail as one APDU, split in frames of the PN532
+    chained with the MI bit, and collects the whole answer
+
+    @returns Length of the answer, SW included, or -1 for an error
+*/
+/**************************************************************************/
+int16_t ISO7816::exchange(const uint8_t *head, uint8_t headLength, const uint8_t *data, uint16_t dataLength,
+                          const uint8_t *tail, uint8_t tailLength, uint8_t *response, uint16_t responseSize)
+{
+    // Frames are built in the PN532 buffer, after the command and Tg bytes
+    uint8_t size;
+    uint8_t *frame = _nfc->getBuffer(&size) + 2;
+    if (size > ISO7816_FRAME_SIZE) {
+        size = ISO7816_FRAME_SIZE;
+    }
+
+    uint16_t total = headLength + dataLength + tailLength;
+    uint16_t position = 0;
+    uint8_t frameLength;
+    bool moreData;
+
+    for (;;) {
+        for (frameLength = 0; frameLength < size && position < total; frameLength++, position++) {
+            if (position < headLength) {
+                frame[frameLength] = head[position];
+            } else if (position < headLength + dataLength) {
+                frame[frameLength] = data[position - headLength];
+            } else {
+                frame[frameLength] = tail[position - headLength - dataLength];
+            }
+        }
+
+        if (position == total) {
+            break;
+        }
+
+        _exchanges++;
+        if (0 != _nfc->inDataExchangeChained(frame, frameLength, true, frame, size, &moreData)) {
+            DMSG_STR("Chained frame not acknowledged");
+            return -1;
+        }
+    }
+
+    uint16_t received = 0;
+    do {
+        uint16_t room = responseSize - received;
+        if (room > 0xFF) {
+            room = 0xFF;
+        }
+
+        _exchanges++;
+        int16_t length = _nfc->inDataExchangeChained(frame, frameLength, false, response + received, room, &moreData);
+        if (length < 0) {
+            return -1;
+        }
+
+        received += length;
+        frameLength = 0;
+    } while (moreData);
+
+    return received;
+}
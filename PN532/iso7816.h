@@ -0,0 +1,97 @@
+/**************************************************************************/
+/*!
+    @file     iso7816.h
+    @license  BSD
+
+    ISO 7816-4 APDU exchange with an inlisted ISO14443-4 card.  Handles
+    GET RESPONSE (SW 61xx), wrong Le (SW 6Cxx), command chaining and
+    extended length APDUs, on top of the PN532 frame chaining.
+*/
+/**************************************************************************/
+
+#ifndef __ISO7816_H__
+#define __ISO7816_H__
+
+#include "PN532.h"
+
+#ifndef ISO7816_FRAME_SIZE
+#define ISO7816_FRAME_SIZE          60  // bytes per InDataExchange, 22 with I2C
+#endif
+
+#define ISO7816_SHORT_LC            (255)
+#define ISO7816_SHORT_LE            (256)
+#define ISO7816_RESPONSE_OVERHEAD   (3)     // status byte and SW1 SW2
+
+#define ISO7816_CLA_CHAINING        (0x10)
+#define ISO7816_INS_GET_RESPONSE    (0xC0)
+
+#define ISO7816_SW_OK               (0x9000)
+#define ISO7816_SW1_MORE_DATA       (0x61)
+#define ISO7816_SW1_WRONG_LE        (0x6C)
+
+// Card capabilities, from the historical bytes of the ATS
+#define ISO7816_CAP_CHAINING        (0x80)
+#define ISO7816_CAP_EXTENDED        (0x40)
+
+// Command APDU; data is owned by the caller and only read
+typedef struct {
+    uint8_t cla;
+    uint8_t ins;
+    uint8_t p1;
+    uint8_t p2;
+    const uint8_t *data;
+    uint16_t lc;        // length of data
+    uint16_t le;        // expected length, 0 if no data is expected
+} iso7816_command_t;
+
+// Response APDU; data points to size bytes owned by the caller
+typedef struct {
+    uint8_t *data;
+    uint16_t size;      // expected length + ISO7816_RESPONSE_OVERHEAD
+    uint16_t length;    // length of data, SW excluded
+    uint16_t sw;        // SW1 SW2
+} iso7816_response_t;
+
+class ISO7816 {
+public:
+    ISO7816(PN532 &nfc);
+
+    /**
+    * @brief    read the capabilities of the inlisted card from its ATS,
+    *           extended length is used if the card advertises it
+    * @return   ISO7816_CAP_* flags of the card
+    */
+    uint8_t begin();
+
+    void setExtendedLength(bool enabled) { _extended = enabled; };
+    bool extendedLength() { return _extended; };
+
+    /**
+    * @brief    send a command APDU and get the whole response.  GET
+    *           RESPONSE is sent while the card has more data, and the
+    *           command is sent again with the right Le on SW 6Cxx.  Lc
+    *           over 255 uses extended length if the card supports it,
+    *           otherwise command chaining.
+    * @param    command     the command
+    * @param    response    gets the data and the status word
+    * @return   1 if a status word was received, 0 for an error
+    */
+    uint8_t transceive(const iso7816_command_t *command, iso7816_response_t *response);
+
+    static uint8_t parseCapabilities(const uint8_t *ats, uint8_t atsLength);
+
+    // PN532 exchanges since the last resetStats, frames of a chain included
+    uint16_t exchanges() { return _exchanges; };
+    void resetStats() { _exchanges = 0; };
+
+private:
+    uint8_t send(const iso7816_command_t *command, const uint8_t *data, uint16_t lc, uint8_t cla, uint16_t le, iso7816_response_t *response);
+    int16_t exchange(const uint8_t *head, uint8_t headLength, const uint8_t *data, uint16_t dataLength,
+                     const uint8_t *tail, uint8_t tailLength, uint8_t *response, uint16_t responseSize);
+
+    PN532 *_nfc;
+    bool _extended;
+    uint16_t _exchanges;
+};
+
+#endif
@@ -10,7 +10,7 @@
 
 class LLCP {
 public:
-	LLCP(PN532Interface &interface) : link(interface) {
+	LLCP(PN532Transport &interface, PN532_BUFFER_ARGS) : link(interface, buffer, size) {
         headerBuf = link.getHeaderBuffer(&headerBufLen);
         ns = 0;
         nr = 0;
@@ -59,6 +59,11 @@ public:
         return buf;
     };
 
+    // outcome of the last PN532 command, see PN532::getStatus
+    pn532_status_t getStatus() {
+        return link.getStatus();
+    };
+
 private:
 	MACLink link;
     uint8_t mode;
@@ -6,15 +6,62 @@ int8_t MACLink::activateAsTarget(uint16_t timeout)
 {
 	pn532.begin();
 	pn532.SAMConfig();
+    initiator = false;
     return pn532.tgInitAsTarget(timeout);
 }
 
+int8_t MACLink::activateAsInitiator(bool active, uint8_t baudrate, uint16_t timeout)
+{
+    // LLCP magic number, version parameter and MIUX, as sent by tgInitAsTarget
+    const uint8_t generalBytes[] = { 0x46, 0x66, 0x6D, 0x01, 0x01, 0x10, 0x02, 0x02, 0x00, 0x80 };
+
+    pn532.begin();
+    pn532.SAMConfig();
+    // Give up after a few ATR_REQ / polls, so the next rate can be tried
+    pn532.setMaxRetries(0x02, 0x01, 0x02);
+
+    initiator = true;
+    int8_t result = -1;
+    for (int8_t rate = baudrate; rate >= PN532_BR_106; rate--) {
+        if (pn532.inJumpForDEP(active, rate, generalBytes, sizeof(generalBytes), 0, 0, timeout)) {
+            DMSG("DEP at rate "); DMSG_INT(rate); DMSG("\n");
+            result = 1;
+            break;
+        }
+        if (PN532_CANCELLED == pn532.getStatus().transport) {
+            result = PN532_CANCELLED;
+            break;
+        }
+    }
+
+    if (-1 == result) {
+        pn532_status_t status = pn532.getStatus();
+        if (PN532_TIMEOUT == status.transport || PN532_ERROR_TIMEOUT == status.error) {
+            result = 0;
+        }
+    }
+
+    // The retries stay set on the chip: give the next activation or
+    // poll the defaults back.  The link is up already, they no longer
+    // matter to it.
+    pn532.setMaxRetries(PN532_RF_DEFAULT.maxRtyATR, PN532_RF_DEFAULT.maxRtyPSL,
+                        PN532_RF_DEFAULT.maxRtyPassiveActivation);
+
+    return result;
+}
+
 bool MACLink::write(const uint8_t *header, uint8_t hlen, const uint8_t *body, uint8_t blen)
 {
+    if (initiator) {
+        return pn532.inSetData(header, hlen, body, blen);
+    }
     return pn532.tgSetData(header, hlen, body, blen);
 }
 
 int16_t MACLink::read(uint8_t *buf, uint8_t len)
 {
+    if (initiator) {
+        return pn532.inGetData(buf, len);
+    }
     return pn532.tgGetData(buf, len);
 }
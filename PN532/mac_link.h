@@ -7,7 +7,7 @@
 
 class MACLink {
 public:
-    MACLink(PN532Interface &interface) : pn532(interface) {
+    MACLink(PN532Transport &interface, PN532_BUFFER_ARGS) : pn532(interface, buffer, size), initiator(false) {
 
     };
     
@@ -20,6 +20,21 @@ public:
     */
     int8_t activateAsTarget(uint16_t timeout = 0);
 
+    /**
+    * @brief    Activate PN532 as an NFC-DEP initiator, LLCP parameters in
+    *           the general bytes.  When no target answers at baudrate,
+    *           the lower rates are tried.  Then write() sends a PDU and
+    *           read() gets the answer of the target.  The activation
+    *           retries are set back to their defaults before returning.
+    * @param    active      true for active mode, false for passive
+    * @param    baudrate    highest rate to try: PN532_BR_106, 212 or 424
+    * @param    timeout     max time to wait at each rate
+    * @return   > 0     success
+    *           = 0     no target
+    *           < 0     failed
+    */
+    int8_t activateAsInitiator(bool active = false, uint8_t baudrate = PN532_BR_424, uint16_t timeout = 1000);
+
     /**
     * @brief    write a PDU packet, the packet should be less than (255 - 2) bytes
     * @param    header  packet header
@@ -43,9 +58,15 @@ public:
     uint8_t *getHeaderBuffer(uint8_t *len) {
         return pn532.getBuffer(len);
     };
+
+    // outcome of the last PN532 command, see PN532::getStatus
+    pn532_status_t getStatus() {
+        return pn532.getStatus();
+    };
     
 private:
     PN532 pn532;
+    bool initiator;
 };
 
 #endif // __MAC_LINK_H__
@@ -0,0 +1,249 @@
+
+#include "mifareclassic_image.h"
+#include "PN532_debug.h"
+
+#include <string.h>
+
+// trailer conditions 000, 010 and 001 make key B readable with key A
+static bool keyBReadable(const uint8_t *conditions)
+{
+    return (conditions[3] & 0x07) <= 0x02;
+}
+
+uint8_t MifareClassicImage::dump(const uint8_t *uid, uint8_t uidLen, uint8_t *image, uint8_t sectorCount, uint8_t *keys)
+{
+    uint8_t dumped = 0;
+    uint8_t conditions[4];
+
+    memset(image, 0, imageSize(sectorCount));
+    if (keys) {
+        memset(keys, 0, sectorCount);
+    }
+
+    for (uint8_t sector = 0; sector < sectorCount; sector++) {
+        uint8_t keyNumber;
+        const uint8_t *key;
+        uint8_t *data = image + _nfc->mifareclassic_SectorFirstBlock(sector) * MIFARE_CLASSIC_BLOCK_SIZE;
+        uint8_t blockCount = _nfc->mifareclassic_SectorBlockCount(sector);
+
+        if (!_keys->authenticate(uid, uidLen, sector, &keyNumber, &key)) {
+            DMSG("No key for sector ");
+            DMSG_INT(sector);
+            DMSG("\n");
+            continue;
+        }
+
+        // already authenticated, so this only reads
+        if (!_nfc->mifareclassic_ReadSector(uid, uidLen, sector, keyNumber, key, data)) {
+            memset(data, 0, blockCount * MIFARE_CLASSIC_BLOCK_SIZE);
+            _nfc->reselectPassiveTarget(uid, uidLen);
+            continue;
+        }
+        blocksRead += blockCount;
+
+        // keys read back as zeros, put the one we know in the image
+        uint8_t *trailer = data + (blockCount - 1) * MIFARE_CLASSIC_BLOCK_SIZE;
+        memcpy(trailer + (keyNumber ? 10 : 0), key, 6);
+
+        if (keys) {
+            keys[sector] = keyNumber ? MIFARE_IMAGE_KEY_B : MIFARE_IMAGE_KEY_A;
+            if (!keyNumber && _nfc->mifareclassic_ParseAccessBits(trailer + 6, conditions) &&
+                    keyBReadable(conditions)) {
+                keys[sector] |= MIFARE_IMAGE_KEY_B;
+            }
+        }
+
+        dumped++;
+    }
+
+    return dumped;
+}
+
+uint8_t MifareClassicImage::restore(const uint8_t *uid, uint8_t uidLen, const uint8_t *image, uint8_t sectorCount, const uint8_t *keys)
+{
+    uint8_t result = 1;
+    bool trailersChanged = false;
+    uint8_t block[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t trailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t merged[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t conditions[4];
+    uint8_t expectedConditions[4];
+
+    for (uint8_t sector = 0; sector < sectorCount; sector++) {
+        uint8_t keyNumber;
+        const uint8_t *key;
+        uint8_t firstBlock = _nfc->mifareclassic_SectorFirstBlock(sector);
+        uint8_t blockCount = _nfc->mifareclassic_SectorBlockCount(sector);
+        uint8_t trailerBlock = firstBlock + blockCount - 1;
+
+        if (!_keys->authenticate(uid, uidLen, sector, &keyNumber, &key)) {
+            result = 0;
+            continue;
+        }
+
+        // the access bits tell which key may read and write each block
+        if (!_nfc->mifareclassic_ReadDataBlock(trailerBlock, trailer)) {
+            _nfc->reselectPassiveTarget(uid, uidLen);
+            result = 0;
+            continue;
+        }
+        blocksRead++;
+
+        if (!_nfc->mifareclassic_ParseAccessBits(trailer + 6, conditions)) {
+            DMSG("Invalid access bits in sector ");
+            DMSG_INT(sector);
+            DMSG("\n");
+            result = 0;
+            continue;
+        }
+
+        // keys of the card we know: the one we authenticated with, and
+        // key B when it reads back in clear
+        uint8_t cardKeys = keyNumber ? MIFARE_IMAGE_KEY_B : MIFARE_IMAGE_KEY_A;
+        memcpy(trailer + (keyNumber ? 10 : 0), key, 6);
+        if (!keyNumber && keyBReadable(conditions)) {
+            cardKeys |= MIFARE_IMAGE_KEY_B;
+        }
+
+        for (uint8_t i = 0; i < blockCount; i++) {
+            uint8_t blockNumber = firstBlock + i;
+            const uint8_t *expected = image + blockNumber * MIFARE_CLASSIC_BLOCK_SIZE;
+            uint8_t permissions = _nfc->mifareclassic_AccessPermissions(conditions, _nfc->mifareclassic_AccessGroup(blockNumber));
+            uint8_t readKey = _nfc->mifareclassic_KeyForOperation(permissions, MIFARE_ACCESS_OP_READ, keyNumber);
+            uint8_t writeKey = _nfc->mifareclassic_KeyForOperation(permissions, MIFARE_ACCESS_OP_WRITE, keyNumber);
+
+            if (0 == blockNumber) {
+                continue;   // manufacturer block
+            }
+
+            if (blockNumber == trailerBlock) {
+                if (!keys) {
+                    continue;
+                }
+                // invalid access bits would lock the sector for good
+                if (!_nfc->mifareclassic_ParseAccessBits(expected + 6, expectedConditions)) {
+                    DMSG("Invalid access bits in the image for sector ");
+                    DMSG_INT(sector);
+                    DMSG("\n");
+                    blocksRefused++;
+                    result = 0;
+                    continue;
+                }
+
+                // the card keeps its own key where the image does not know it
+                uint8_t mergedKeys = keys[sector];
+                memcpy(merged, expected, MIFARE_CLASSIC_BLOCK_SIZE);
+                for (uint8_t k = 0; k < 2; k++) {
+                    uint8_t flag = k ? MIFARE_IMAGE_KEY_B : MIFARE_IMAGE_KEY_A;
+
+                    if (mergedKeys & flag) {
+                        continue;
+                    }
+                    if (!(cardKeys & flag)) {
+                        if (!_keys->authenticateWithKeyType(uid, uidLen, sector, k, &key)) {
+                            keyNumber = MIFARE_CLASSIC_NO_KEY;  // authenticate again to write
+                            continue;
+                        }
+                        keyNumber = k;
+                        memcpy(trailer + (k ? 10 : 0), key, 6);
+                        cardKeys |= flag;
+                    }
+                    memcpy(merged + (k ? 10 : 0), trailer + (k ? 10 : 0), 6);
+                    mergedKeys |= flag;
+                }
+
+                // a key of the image the card may already have: try it
+                // rather than rewriting the trailer for nothing
+                for (uint8_t k = 0; k < 2; k++) {
+                    uint8_t flag = k ? MIFARE_IMAGE_KEY_B : MIFARE_IMAGE_KEY_A;
+
+                    if ((cardKeys & flag) || !(keys[sector] & flag)) {
+                        continue;
+                    }
+                    if (!_nfc->mifareclassic_AuthenticateSector(uid, uidLen, sector, k, merged + (k ? 10 : 0))) {
+                        _nfc->reselectPassiveTarget(uid, uidLen);
+                        keyNumber = MIFARE_CLASSIC_NO_KEY;
+                        break;
+                    }
+                    keyNumber = k;
+                    key = merged + (k ? 10 : 0);
+                    memcpy(trailer + (k ? 10 : 0), key, 6);
+                    cardKeys |= flag;
+                }
+
+                // nothing to write when the access bits match and the card
+                // already has every key the image knows
+                bool same = (0 == memcmp(trailer + 6, merged + 6, 4));
+                for (uint8_t k = 0; same && k < 2; k++) {
+                    uint8_t flag = k ? MIFARE_IMAGE_KEY_B : MIFARE_IMAGE_KEY_A;
+
+                    if (keys[sector] & flag) {
+                        same = (cardKeys & flag) && 0 == memcmp(trailer + (k ? 10 : 0), merged + (k ? 10 : 0), 6);
+                    }
+                }
+                if (same) {
+                    continue;
+                }
+
+                // never write a key nobody knows
+                if (mergedKeys != (MIFARE_IMAGE_KEY_A | MIFARE_IMAGE_KEY_B)) {
+                    DMSG("Unknown key in sector ");
+                    DMSG_INT(sector);
+                    DMSG("\n");
+                    blocksRefused++;
+                    result = 0;
+                    continue;
+                }
+                expected = merged;
+            } else if (readKey == keyNumber) {
+                if (!_nfc->mifareclassic_ReadDataBlock(blockNumber, block)) {
+                    _nfc->reselectPassiveTarget(uid, uidLen);
+                    result = 0;
+                    break;
+                }
+                blocksRead++;
+
+                if (0 == memcmp(block, expected, MIFARE_CLASSIC_BLOCK_SIZE)) {
+                    continue;
+                }
+            }
+
+            // not allowed by any key: do not even try
+            if (MIFARE_CLASSIC_NO_KEY == writeKey) {
+                DMSG("Access bits forbid writing block ");
+                DMSG_INT(blockNumber);
+                DMSG("\n");
+                blocksRefused++;
+                result = 0;
+                continue;
+            }
+
+            // switch to the key the access bits require
+            if (writeKey != keyNumber) {
+                if (!_keys->authenticateWithKeyType(uid, uidLen, sector, writeKey, &key)) {
+                    blocksRefused++;
+                    result = 0;
+                    break;
+                }
+                keyNumber = writeKey;
+            }
+
+            if (!_nfc->mifareclassic_WriteDataBlock(blockNumber, (uint8_t *)expected)) {
+                _nfc->reselectPassiveTarget(uid, uidLen);
+                result = 0;
+                break;
+            }
+            blocksWritten++;
+            if (blockNumber == trailerBlock) {
+                trailersChanged = true;
+            }
+        }
+    }
+
+    // The keys of the card changed
+    if (trailersChanged) {
+        _keys->forget(uid, uidLen);
+    }
+
+    return result;
+}
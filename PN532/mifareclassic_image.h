@@ -0,0 +1,90 @@
+/**************************************************************************/
+/*!
+    @file     mifareclassic_image.h
+    @license  BSD
+
+    Whole-card images of Mifare Classic 1K/4K cards.  The image layout is
+    the one of .mfd files (all blocks in order, 16 bytes each, keys
+    filled in the sector trailers), so the image buffer can be a plain
+    array on a microcontroller or an mmap'd .mfd file on a host.
+*/
+/**************************************************************************/
+
+#ifndef __MIFARECLASSIC_IMAGE_H__
+#define __MIFARECLASSIC_IMAGE_H__
+
+#include "PN532.h"
+#include "mifareclassic_keys.h"
+
+#define MIFARE_CLASSIC_1K_IMAGE_SIZE    (1024)
+#define MIFARE_CLASSIC_4K_IMAGE_SIZE    (4096)
+
+// which keys of a sector trailer in the image are real (see dump)
+#define MIFARE_IMAGE_KEY_A              (0x01)
+#define MIFARE_IMAGE_KEY_B              (0x02)
+
+class MifareClassicImage {
+public:
+    MifareClassicImage(PN532 &nfc, MifareClassicKeys &keys) : _nfc(&nfc), _keys(&keys) {
+        resetStats();
+    };
+
+    /**
+    * @brief    read a whole card into an image
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    image       buffer of 16 bytes per block (1024 bytes for
+    *                       16 sectors, 4096 bytes for 40 sectors)
+    * @param    sectorCount MIFARE_CLASSIC_1K_SECTORS or MIFARE_CLASSIC_4K_SECTORS
+    * @param    keys        if not 0, sectorCount bytes receiving the
+    *                       MIFARE_IMAGE_KEY_x flags of the trailer keys
+    *                       that are known.  The other keys are left zeroed
+    *                       in the image.
+    * @return   number of sectors read, the other ones are left zeroed
+    */
+    uint8_t dump(const uint8_t *uid, uint8_t uidLen, uint8_t *image, uint8_t sectorCount, uint8_t *keys = 0);
+
+    /**
+    * @brief    write an image back to a card.  Every block is read first
+    *           and only the blocks that differ from the image are
+    *           written.  The access bits of the card are used to pick
+    *           the key of each read and write up front, and blocks no
+    *           key may write are skipped without being sent.  Blocks
+    *           that can not be read with the current key are written
+    *           without comparison.  Block 0 is never written.
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    image       image to restore
+    * @param    sectorCount MIFARE_CLASSIC_1K_SECTORS or MIFARE_CLASSIC_4K_SECTORS
+    * @param    keys        if not 0, also restore the sector trailers (keys
+    *                       and access bits).  sectorCount bytes of
+    *                       MIFARE_IMAGE_KEY_x flags, as filled by dump,
+    *                       telling which keys of the image are known.  The
+    *                       card keeps its own key where the image does not
+    *                       know it, and trailers with invalid access bits
+    *                       or a key nobody knows are refused.
+    * @return   1           the card matches the image
+    *           0           some blocks could not be read or written
+    */
+    uint8_t restore(const uint8_t *uid, uint8_t uidLen, const uint8_t *image, uint8_t sectorCount, const uint8_t *keys = 0);
+
+    static uint16_t imageSize(uint8_t sectorCount) {
+        return (sectorCount <= 32) ? sectorCount * 64 : 2048 + (sectorCount - 32) * 256;
+    };
+
+    void resetStats() {
+        blocksRead = 0;
+        blocksWritten = 0;
+        blocksRefused = 0;
+    };
+
+    uint16_t blocksRead;        // blocks read from the card
+    uint16_t blocksWritten;     // blocks written to the card
+    uint16_t blocksRefused;     // differing blocks the access bits do not allow to write
+
+private:
+    PN532 *_nfc;
+    MifareClassicKeys *_keys;
+};
+
+#endif
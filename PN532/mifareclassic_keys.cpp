@@ -0,0 +1,154 @@
+
+#include "mifareclassic_keys.h"
+#include "PN532_debug.h"
+
+#include <string.h>
+
+MifareClassicKeys::MifareClassicKeys(PN532 &nfc, const uint8_t (*keys)[6], uint8_t keyCount)
+{
+    _nfc = &nfc;
+    _keys = keys;
+    _keyCount = (keyCount > MIFARE_KEYCACHE_INDEX) ? MIFARE_KEYCACHE_INDEX : keyCount;
+    clear();
+}
+
+void MifareClassicKeys::clear()
+{
+    memset(_cache, 0, sizeof(_cache));
+}
+
+void MifareClassicKeys::forget(const uint8_t *uid, uint8_t uidLen)
+{
+    CacheEntry *entry = lookup(uid, uidLen, false);
+    if (entry) {
+        entry->uidLen = 0;
+    }
+}
+
+/**
+    @brief  find the cache entry of a card and move it to the front.
+            With create set, the least recently used entry is recycled
+            for an unknown card.
+*/
+MifareClassicKeys::CacheEntry *MifareClassicKeys::lookup(const uint8_t *uid, uint8_t uidLen, bool create)
+{
+    uint8_t i;
+
+    if (uidLen > sizeof(_cache[0].uid)) {
+        return 0;
+    }
+
+    for (i = 0; i < MIFARE_KEYCACHE_CARDS; i++) {
+        if (_cache[i].uidLen == uidLen && 0 == memcmp(_cache[i].uid, uid, uidLen)) {
+            break;
+        }
+    }
+
+    if (i == MIFARE_KEYCACHE_CARDS) {
+        if (!create) {
+            return 0;
+        }
+        i = MIFARE_KEYCACHE_CARDS - 1;
+        memset(&_cache[i], 0, sizeof(CacheEntry));
+        memcpy(_cache[i].uid, uid, uidLen);
+        _cache[i].uidLen = uidLen;
+    }
+
+    if (i > 0) {
+        CacheEntry entry = _cache[i];
+        memmove(&_cache[1], &_cache[0], i * sizeof(CacheEntry));
+        _cache[0] = entry;
+    }
+
+    return &_cache[0];
+}
+
+/**
+    @brief  try one cache candidate (key index + 1 and key type), re-selecting the card if it
+            is refused (a failed authentication leaves the card idle)
+    @return 1 authenticated, 0 key refused, -1 card lost
+*/
+int8_t MifareClassicKeys::tryKey(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t candidate)
+{
+    uint8_t keyNumber = (candidate & MIFARE_KEYCACHE_KEY_B) ? 1 : 0;
+    const uint8_t *key = _keys[(candidate & MIFARE_KEYCACHE_INDEX) - 1];
+
+    if (_nfc->mifareclassic_AuthenticateSector(uid, uidLen, sectorNumber, keyNumber, key)) {
+        return 1;
+    }
+
+    if (!_nfc->reselectPassiveTarget(uid, uidLen)) {
+        DMSG("Card lost during key search\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+uint8_t MifareClassicKeys::authenticate(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                                        uint8_t *keyNumber, const uint8_t **key)
+{
+    return search(uid, uidLen, sectorNumber, 0x3, keyNumber, key);
+}
+
+uint8_t MifareClassicKeys::authenticateWithKeyType(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                                                   uint8_t keyNumber, const uint8_t **key)
+{
+    return search(uid, uidLen, sectorNumber, keyNumber ? 0x2 : 0x1, 0, key);
+}
+
+/**
+    @param  types   bit 0: try keys A, bit 1: try keys B
+*/
+uint8_t MifareClassicKeys::search(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t types,
+                                  uint8_t *keyNumber, const uint8_t **key)
+{
+    if (sectorNumber >= MIFARE_KEYCACHE_SECTORS) {
+        return 0;
+    }
+
+    CacheEntry *entry = lookup(uid, uidLen, true);
+    uint8_t cached = entry ? entry->sectors[sectorNumber] : 0;
+    uint8_t candidate;
+    int8_t status = 0;
+
+    // Returning card: the cached key should work on the first try
+    if ((cached & MIFARE_KEYCACHE_INDEX) && ((cached & MIFARE_KEYCACHE_INDEX) <= _keyCount) &&
+            (types & ((cached & MIFARE_KEYCACHE_KEY_B) ? 0x2 : 0x1))) {
+        candidate = cached;
+        status = tryKey(uid, uidLen, sectorNumber, candidate);
+        if (status < 0) {
+            return 0;
+        }
+    }
+
+    // Otherwise every key of the dictionary, key A then key B
+    for (uint8_t index = 0; (0 == status) && (index < _keyCount); index++) {
+        for (uint8_t type = 0; (0 == status) && (type < 2); type++) {
+            candidate = (index + 1) | (type ? MIFARE_KEYCACHE_KEY_B : 0);
+            if (!(types & (1 << type)) || (candidate == cached)) {
+                continue;   // wrong type or already tried above
+            }
+            status = tryKey(uid, uidLen, sectorNumber, candidate);
+        }
+    }
+
+    if (1 != status) {
+        if (entry && (types & ((cached & MIFARE_KEYCACHE_KEY_B) ? 0x2 : 0x1))) {
+            entry->sectors[sectorNumber] = 0;
+        }
+        return 0;
+    }
+
+    if (entry) {
+        entry->sectors[sectorNumber] = candidate;
+    }
+    if (keyNumber) {
+        *keyNumber = (candidate & MIFARE_KEYCACHE_KEY_B) ? 1 : 0;
+    }
+    if (key) {
+        *key = _keys[(candidate & MIFARE_KEYCACHE_INDEX) - 1];
+    }
+
+    return 1;
+}
@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*!
+    @file     mifareclassic_keys.h
+    @license  BSD
+
+    Key dictionary for Mifare Classic cards with mixed keys.  The key
+    that opened a sector is remembered per card, so a returning card
+    authenticates on the first try.
+*/
+/**************************************************************************/
+
+#ifndef __MIFARECLASSIC_KEYS_H__
+#define __MIFARECLASSIC_KEYS_H__
+
+#include "PN532.h"
+
+#ifndef MIFARE_KEYCACHE_CARDS
+#define MIFARE_KEYCACHE_CARDS       4   // number of cards remembered
+#endif
+
+#ifndef MIFARE_KEYCACHE_SECTORS
+#define MIFARE_KEYCACHE_SECTORS     40  // 16 is enough for 1K cards only
+#endif
+
+#define MIFARE_KEYCACHE_KEY_B       (0x80)  // cached key is a key B
+#define MIFARE_KEYCACHE_INDEX       (0x7F)  // dictionary index + 1, 0 = unknown
+
+class MifareClassicKeys {
+public:
+    /**
+    * @param    nfc         PN532 the card is inlisted on
+    * @param    keys        dictionary of 6 bytes keys, tried in order
+    * @param    keyCount    number of keys in the dictionary (max 127)
+    */
+    MifareClassicKeys(PN532 &nfc, const uint8_t (*keys)[6], uint8_t keyCount);
+
+    /**
+    * @brief    authenticate a sector, with the cached key if there is one,
+    *           otherwise by trying every key of the dictionary as key A
+    *           then key B.  The card is re-selected after each failure.
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    sectorNumber    sector to authenticate
+    * @param    keyNumber   key type that worked (0 = A, 1 = B), may be 0
+    * @param    key         key that worked, may be 0
+    * @return   1           success
+    *           0           no key of the dictionary works or card is gone
+    */
+    uint8_t authenticate(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                         uint8_t *keyNumber = 0, const uint8_t **key = 0);
+
+    /**
+    * @brief    same as authenticate, but only with keys of one type, for
+    *           operations the access bits grant to a single key
+    * @param    keyNumber   key type to use (0 = A, 1 = B)
+    */
+    uint8_t authenticateWithKeyType(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                                    uint8_t keyNumber, const uint8_t **key = 0);
+
+    void forget(const uint8_t *uid, uint8_t uidLen);
+    void clear();
+
+private:
+    struct CacheEntry {
+        uint8_t uid[7];
+        uint8_t uidLen;     // 0 = free entry
+        uint8_t sectors[MIFARE_KEYCACHE_SECTORS];
+    };
+
+    PN532 *_nfc;
+    const uint8_t (*_keys)[6];
+    uint8_t _keyCount;
+    CacheEntry _cache[MIFARE_KEYCACHE_CARDS];   // most recently used first
+
+    CacheEntry *lookup(const uint8_t *uid, uint8_t uidLen, bool create);
+    uint8_t search(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t types,
+                   uint8_t *keyNumber, const uint8_t **key);
+    int8_t tryKey(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber, uint8_t candidate);
+};
+
+#endif
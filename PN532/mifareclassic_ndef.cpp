@@ -0,0 +1,374 @@
+
+#include "mifareclassic_ndef.h"
+#include "PN532_debug.h"
+
+#include <string.h>
+
+#define NDEF_TLV_NULL           (0x00)
+#define NDEF_TLV_MESSAGE        (0x03)
+#define NDEF_TLV_TERMINATOR     (0xFE)
+
+const uint8_t MIFARE_MAD_ACCESS[4]      = {0x78, 0x77, 0x88, 0xC1};
+const uint8_t MIFARE_MAD2_ACCESS[4]     = {0x78, 0x77, 0x88, 0xC2};
+const uint8_t MIFARE_MAD_RO_ACCESS[4]   = {0x07, 0x8F, 0x0F, 0xC1};
+const uint8_t MIFARE_NDEF_ACCESS[4]     = {0x7F, 0x07, 0x88, 0x40};
+const uint8_t MIFARE_NDEF_RO_ACCESS[4]  = {0x07, 0x8F, 0x0F, 0x43};
+const uint8_t MIFARE_MAD_KEY_A[6]       = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5};
+const uint8_t MIFARE_NDEF_KEY_A[6]      = {0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7};
+const uint8_t MIFARE_DEFAULT_KEY_B[6]   = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+uint8_t MifareClassicNdef::madCrc(const uint8_t *data, uint8_t length)
+{
+    uint8_t crc = 0xC7;
+
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x1D : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+uint16_t MifareClassicNdef::capacity(uint8_t sectorCount)
+{
+    uint16_t bytes = 0;
+
+    for (uint8_t sector = 1; sector < sectorCount; sector++) {
+        if (MIFARE_MAD2_SECTOR == sector) {
+            continue;
+        }
+        bytes += (PN532::mifareclassic_SectorBlockCount(sector) - 1) * MIFARE_CLASSIC_BLOCK_SIZE;
+    }
+
+    // TLV header (3 bytes form above 254 bytes) and terminator
+    if (bytes < 2 + 0xFE + 1) {
+        return bytes - 3;
+    }
+    return bytes - 5;
+}
+
+uint8_t MifareClassicNdef::prepareSector(const uint8_t *uid, uint8_t uidLen, uint8_t sector, uint8_t firstGroup,
+                                         const uint8_t *targetAccess, uint8_t *trailer)
+{
+    uint8_t keyNumber;
+    uint8_t conditions[4];
+    uint8_t trailerBlock = _nfc->mifareclassic_SectorFirstBlock(sector) + _nfc->mifareclassic_SectorBlockCount(sector) - 1;
+
+    if (!_keys->authenticate(uid, uidLen, sector, &keyNumber)) {
+        return 0;
+    }
+
+    if (!_nfc->mifareclassic_ReadDataBlock(trailerBlock, trailer) ||
+            !_nfc->mifareclassic_ParseAccessBits(trailer + 6, conditions)) {
+        return 0;
+    }
+
+    uint8_t permissions = 0xFF;
+    for (uint8_t group = firstGroup; group < 3; group++) {
+        permissions &= _nfc->mifareclassic_AccessPermissions(conditions, group);
+    }
+    if (memcmp(trailer + 6, targetAccess, 4)) {
+        permissions &= _nfc->mifareclassic_AccessPermissions(conditions, 3);
+    }
+
+    uint8_t writeKey = _nfc->mifareclassic_KeyForOperation(permissions, MIFARE_ACCESS_OP_WRITE, keyNumber);
+    if (MIFARE_CLASSIC_NO_KEY == writeKey) {
+        DMSG("Access bits forbid writing sector ");
+        DMSG_INT(sector);
+        DMSG("\n");
+        return 0;
+    }
+
+    if (writeKey != keyNumber) {
+        return _keys->authenticateWithKeyType(uid, uidLen, sector, writeKey);
+    }
+
+    return 1;
+}
+
+uint8_t MifareClassicNdef::write(const uint8_t *uid, uint8_t uidLen, const uint8_t *message, uint16_t length,
+                                 uint8_t sectorCount)
+{
+    bool trailersChanged = false;
+    uint8_t result = writeMessage(uid, uidLen, message, length, sectorCount, &trailersChanged);
+
+    // The keys of the card changed
+    if (trailersChanged) {
+        _keys->forget(uid, uidLen);
+    }
+
+    return result;
+}
+
+/**
+    @brief  body of write
+    @param  trailersChanged     set once a sector trailer was sent
+*/
+uint8_t MifareClassicNdef::writeMessage(const uint8_t *uid, uint8_t uidLen, const uint8_t *message, uint16_t length,
+                                        uint8_t sectorCount, bool *trailersChanged)
+{
+    uint8_t mad[2 * MIFARE_CLASSIC_BLOCK_SIZE];     // blocks 1 and 2
+    uint8_t mad2[3 * MIFARE_CLASSIC_BLOCK_SIZE];    // blocks 64 to 66
+    uint8_t block[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t trailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t header[4];
+    uint8_t headerLength;
+    uint16_t tlvLength;
+    uint16_t position = 0;
+
+    if ((sectorCount != MIFARE_CLASSIC_1K_SECTORS) && (sectorCount != MIFARE_CLASSIC_4K_SECTORS)) {
+        return 0;
+    }
+
+    if (length > capacity(sectorCount)) {
+        DMSG("NDEF message too large\n");
+        return 0;
+    }
+
+    header[0] = NDEF_TLV_MESSAGE;
+    if (length < 0xFF) {
+        header[1] = length;
+        headerLength = 2;
+    } else {
+        header[1] = 0xFF;
+        header[2] = length >> 8;
+        header[3] = length & 0xFF;
+        headerLength = 4;
+    }
+    tlvLength = headerLength + length + 1;
+
+    memset(mad, 0, sizeof(mad));
+    memset(mad2, 0, sizeof(mad2));
+    mad[1] = MIFARE_MAD_INFO_BYTE;
+    mad2[1] = MIFARE_MAD_INFO_BYTE;
+
+    for (uint8_t sector = 1; (sector < sectorCount) && (position < tlvLength); sector++) {
+        if (MIFARE_MAD2_SECTOR == sector) {
+            continue;
+        }
+
+        uint8_t firstBlock = _nfc->mifareclassic_SectorFirstBlock(sector);
+        uint8_t dataBlocks = _nfc->mifareclassic_SectorBlockCount(sector) - 1;
+
+        if (!prepareSector(uid, uidLen, sector, 0, MIFARE_NDEF_ACCESS, trailer)) {
+            return 0;
+        }
+
+        // Data blocks, straight from the TLV stream
+        for (uint8_t i = 0; i < dataBlocks; i++) {
+            for (uint8_t j = 0; j < MIFARE_CLASSIC_BLOCK_SIZE; j++, position++) {
+                if (position < headerLength) {
+                    block[j] = header[position];
+                } else if (position < headerLength + length) {
+                    block[j] = message[position - headerLength];
+                } else if (position == tlvLength - 1) {
+                    block[j] = NDEF_TLV_TERMINATOR;
+                } else {
+                    block[j] = NDEF_TLV_NULL;
+                }
+            }
+            if (!_nfc->mifareclassic_WriteDataBlock(firstBlock + i, block)) {
+                return 0;
+            }
+        }
+
+        if (memcmp(trailer + 6, MIFARE_NDEF_ACCESS, 4)) {
+            memcpy(block, MIFARE_NDEF_KEY_A, 6);
+            memcpy(block + 6, MIFARE_NDEF_ACCESS, 4);
+            memcpy(block + 10, MIFARE_DEFAULT_KEY_B, 6);
+            *trailersChanged = true;
+            if (!_nfc->mifareclassic_WriteDataBlock(firstBlock + dataBlocks, block)) {
+                return 0;
+            }
+        }
+
+        if (sector < MIFARE_MAD2_SECTOR) {
+            mad[2 * sector] = MIFARE_MAD_NDEF_AID_0;
+            mad[2 * sector + 1] = MIFARE_MAD_NDEF_AID_1;
+        } else {
+            mad2[2 * (sector - MIFARE_MAD2_SECTOR)] = MIFARE_MAD_NDEF_AID_0;
+            mad2[2 * (sector - MIFARE_MAD2_SECTOR) + 1] = MIFARE_MAD_NDEF_AID_1;
+        }
+    }
+
+    // The MAD goes last, so an interrupted write leaves no NDEF sectors
+    // pointed to by a MAD with stale content
+    if (MIFARE_CLASSIC_4K_SECTORS == sectorCount) {
+        uint8_t firstBlock = _nfc->mifareclassic_SectorFirstBlock(MIFARE_MAD2_SECTOR);
+
+        mad2[0] = madCrc(mad2 + 1, sizeof(mad2) - 1);
+        if (!prepareSector(uid, uidLen, MIFARE_MAD2_SECTOR, 0, MIFARE_MAD2_ACCESS, trailer)) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < 3; i++) {
+            if (!_nfc->mifareclassic_WriteDataBlock(firstBlock + i, mad2 + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+                return 0;
+            }
+        }
+        if (memcmp(trailer + 6, MIFARE_MAD2_ACCESS, 4)) {
+            memcpy(block, MIFARE_MAD_KEY_A, 6);
+            memcpy(block + 6, MIFARE_MAD2_ACCESS, 4);
+            memcpy(block + 10, MIFARE_DEFAULT_KEY_B, 6);
+            *trailersChanged = true;
+            if (!_nfc->mifareclassic_WriteDataBlock(firstBlock + 3, block)) {
+                return 0;
+            }
+        }
+    }
+
+    mad[0] = madCrc(mad + 1, sizeof(mad) - 1);
+    const uint8_t *madAccess = (MIFARE_CLASSIC_4K_SECTORS == sectorCount) ? MIFARE_MAD2_ACCESS : MIFARE_MAD_ACCESS;
+    if (!prepareSector(uid, uidLen, MIFARE_MAD_SECTOR, 1, madAccess, trailer)) {
+        return 0;
+    }
+    if (!_nfc->mifareclassic_WriteDataBlock(1, mad) ||
+            !_nfc->mifareclassic_WriteDataBlock(2, mad + MIFARE_CLASSIC_BLOCK_SIZE)) {
+        return 0;
+    }
+    if (memcmp(trailer + 6, madAccess, 4)) {
+        memcpy(block, MIFARE_MAD_KEY_A, 6);
+        memcpy(block + 6, madAccess, 4);
+        memcpy(block + 10, MIFARE_DEFAULT_KEY_B, 6);
+        *trailersChanged = true;
+        if (!_nfc->mifareclassic_WriteDataBlock(3, block)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+    @brief  read and check MAD1, and MAD2 on 4K cards
+    @param  mad     receives the 2 bytes AIDs of sectors 0..sectorCount-1
+*/
+uint8_t MifareClassicNdef::readMad(const uint8_t *uid, uint8_t uidLen, uint8_t sectorCount, uint8_t *mad)
+{
+    uint8_t data[3 * MIFARE_CLASSIC_BLOCK_SIZE];
+
+    if (!_keys->authenticate(uid, uidLen, MIFARE_MAD_SECTOR) ||
+            !_nfc->mifareclassic_ReadDataBlock(1, data) ||
+            !_nfc->mifareclassic_ReadDataBlock(2, data + MIFARE_CLASSIC_BLOCK_SIZE)) {
+        return 0;
+    }
+    if (data[0] != madCrc(data + 1, 2 * MIFARE_CLASSIC_BLOCK_SIZE - 1)) {
+        DMSG("MAD1 CRC error\n");
+        return 0;
+    }
+    memcpy(mad, data, 2 * MIFARE_CLASSIC_BLOCK_SIZE);
+
+    if (MIFARE_CLASSIC_4K_SECTORS == sectorCount) {
+        uint8_t firstBlock = _nfc->mifareclassic_SectorFirstBlock(MIFARE_MAD2_SECTOR);
+
+        if (!_keys->authenticate(uid, uidLen, MIFARE_MAD2_SECTOR)) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < 3; i++) {
+            if (!_nfc->mifareclassic_ReadDataBlock(firstBlock + i, data + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+                return 0;
+            }
+        }
+        if (data[0] != madCrc(data + 1, sizeof(data) - 1)) {
+            DMSG("MAD2 CRC error\n");
+            return 0;
+        }
+        memcpy(mad + 2 * MIFARE_MAD2_SECTOR, data, 2 * (MIFARE_CLASSIC_4K_SECTORS - MIFARE_MAD2_SECTOR));
+    }
+
+    return 1;
+}
+
+int16_t MifareClassicNdef::read(const uint8_t *uid, uint8_t uidLen, ndefSink sink, uint8_t sectorCount)
+{
+    enum { TLV_TYPE, TLV_LENGTH, TLV_LENGTH_HIGH, TLV_LENGTH_LOW, TLV_VALUE } state = TLV_TYPE;
+    uint8_t mad[2 * MIFARE_CLASSIC_4K_SECTORS];
+    uint8_t block[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t type = 0;
+    uint16_t remaining = 0;
+    uint16_t length = 0;
+
+    if ((sectorCount != MIFARE_CLASSIC_1K_SECTORS) && (sectorCount != MIFARE_CLASSIC_4K_SECTORS)) {
+        return -1;
+    }
+
+    if (!readMad(uid, uidLen, sectorCount, mad)) {
+        return -1;
+    }
+
+    for (uint8_t sector = 1; sector < sectorCount; sector++) {
+        if ((MIFARE_MAD2_SECTOR == sector) ||
+                (mad[2 * sector] != MIFARE_MAD_NDEF_AID_0) || (mad[2 * sector + 1] != MIFARE_MAD_NDEF_AID_1)) {
+            continue;
+        }
+
+        uint8_t firstBlock = _nfc->mifareclassic_SectorFirstBlock(sector);
+        uint8_t dataBlocks = _nfc->mifareclassic_SectorBlockCount(sector) - 1;
+
+        if (!_keys->authenticate(uid, uidLen, sector)) {
+            return -2;
+        }
+
+        for (uint8_t i = 0; i < dataBlocks; i++) {
+            if (!_nfc->mifareclassic_ReadDataBlock(firstBlock + i, block)) {
+                return -2;
+            }
+
+            for (uint8_t j = 0; j < MIFARE_CLASSIC_BLOCK_SIZE; j++) {
+                switch (state) {
+                case TLV_TYPE:
+                    type = block[j];
+                    if (NDEF_TLV_TERMINATOR == type) {
+                        DMSG("No NDEF message\n");
+                        return -3;
+                    }
+                    if (NDEF_TLV_NULL != type) {
+                        state = TLV_LENGTH;
+                    }
+                    break;
+                case TLV_LENGTH:
+                    if (0xFF == block[j]) {
+                        state = TLV_LENGTH_HIGH;
+                    } else {
+                        remaining = block[j];
+                        state = TLV_VALUE;
+                    }
+                    break;
+                case TLV_LENGTH_HIGH:
+                    remaining = block[j] << 8;
+                    state = TLV_LENGTH_LOW;
+                    break;
+                case TLV_LENGTH_LOW:
+                    remaining |= block[j];
+                    state = TLV_VALUE;
+                    break;
+                case TLV_VALUE: {
+                    // pass as much of this block as possible at once
+                    uint8_t chunk = MIFARE_CLASSIC_BLOCK_SIZE - j;
+                    if (chunk > remaining) {
+                        chunk = remaining;
+                    }
+                    if (NDEF_TLV_MESSAGE == type) {
+                        sink(block + j, chunk);
+                        length += chunk;
+                    }
+                    remaining -= chunk;
+                    j += chunk - 1;
+                    break;
+                }
+                }
+
+                if ((TLV_VALUE == state) && (0 == remaining)) {
+                    if (NDEF_TLV_MESSAGE == type) {
+                        return length;
+                    }
+                    state = TLV_TYPE;
+                }
+            }
+        }
+    }
+
+    DMSG("NDEF message truncated\n");
+    return -3;
+}
@@ -0,0 +1,107 @@
+/**************************************************************************/
+/*!
+    @file     mifareclassic_ndef.h
+    @license  BSD
+
+    NDEF messages of any size on Mifare Classic 1K/4K cards, following
+    the NFC Forum mapping: MAD1 (and MAD2 on 4K cards) points to the NDEF
+    sectors, and a single NDEF TLV spans as many sectors as needed.
+*/
+/**************************************************************************/
+
+#ifndef __MIFARECLASSIC_NDEF_H__
+#define __MIFARECLASSIC_NDEF_H__
+
+#include "PN532.h"
+#include "mifareclassic_keys.h"
+
+#define MIFARE_MAD_SECTOR               (0)
+#define MIFARE_MAD2_SECTOR              (16)
+#define MIFARE_MAD_NDEF_AID_0           (0x03)  // NDEF application id 0x03E1
+#define MIFARE_MAD_NDEF_AID_1           (0xE1)
+#define MIFARE_MAD_INFO_BYTE            (0x01)  // no card publisher sector
+
+// Sector trailers of the NFC Forum mapping: access bits (bytes 6..9),
+// read-only ones for locked tags, and keys
+extern const uint8_t MIFARE_MAD_ACCESS[4];      // GPB: MAD v1
+extern const uint8_t MIFARE_MAD2_ACCESS[4];     // GPB: MAD v2
+extern const uint8_t MIFARE_MAD_RO_ACCESS[4];
+extern const uint8_t MIFARE_NDEF_ACCESS[4];
+extern const uint8_t MIFARE_NDEF_RO_ACCESS[4];
+extern const uint8_t MIFARE_MAD_KEY_A[6];
+extern const uint8_t MIFARE_NDEF_KEY_A[6];
+extern const uint8_t MIFARE_DEFAULT_KEY_B[6];
+
+class MifareClassicNdef {
+public:
+    /**
+    * @param    nfc     PN532 the card is inlisted on
+    * @param    keys    dictionary with the keys of the card, usually the
+    *                   transport key 0xFF.., the MAD key 0xA0 0xA1.. and
+    *                   the NDEF key 0xD3 0xF7..
+    */
+    MifareClassicNdef(PN532 &nfc, MifareClassicKeys &keys) : _nfc(&nfc), _keys(&keys) { };
+
+    /**
+    * @brief    write an NDEF message, formatting the sectors it needs and
+    *           the MAD.  Each sector is authenticated once and the MAD is
+    *           written last.
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    message     NDEF message (without TLV)
+    * @param    length      length of the message
+    * @param    sectorCount MIFARE_CLASSIC_1K_SECTORS or MIFARE_CLASSIC_4K_SECTORS
+    * @return   1           success
+    *           0           failed, or the message does not fit
+    */
+    uint8_t write(const uint8_t *uid, uint8_t uidLen, const uint8_t *message, uint16_t length,
+                  uint8_t sectorCount = MIFARE_CLASSIC_1K_SECTORS);
+
+    /**
+    * @brief    read the NDEF message.  Only the MAD and the NDEF sectors
+    *           are read, and reading stops at the end of the message.
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    sink        receives the message, one block at most per call
+    * @param    sectorCount MIFARE_CLASSIC_1K_SECTORS or MIFARE_CLASSIC_4K_SECTORS
+    * @return   >=0         length of the message
+    *           <0          failed
+    */
+    int16_t read(const uint8_t *uid, uint8_t uidLen, ndefSink sink,
+                 uint8_t sectorCount = MIFARE_CLASSIC_1K_SECTORS);
+
+    /**
+    * @brief    largest NDEF message that fits on a card
+    */
+    static uint16_t capacity(uint8_t sectorCount);
+
+    /**
+    * @brief    CRC-8 of a MAD (polynomial 0x1D, preset 0xC7)
+    */
+    static uint8_t madCrc(const uint8_t *data, uint8_t length);
+
+    /**
+    * @brief    authenticate a sector with a key that may write its data
+    *           blocks from firstGroup on, and its trailer if it does not
+    *           have the target access bits yet
+    * @param    uid         card uid
+    * @param    uidLen      length of the uid
+    * @param    sector      sector to prepare
+    * @param    firstGroup  first access group that will be written (0..2)
+    * @param    targetAccess    access bits the trailer will get
+    * @param    trailer     receives the current trailer
+    * @return   1 if the sector can be written, 0 otherwise
+    */
+    uint8_t prepareSector(const uint8_t *uid, uint8_t uidLen, uint8_t sector, uint8_t firstGroup,
+                          const uint8_t *targetAccess, uint8_t *trailer);
+
+private:
+    PN532 *_nfc;
+    MifareClassicKeys *_keys;
+
+    uint8_t writeMessage(const uint8_t *uid, uint8_t uidLen, const uint8_t *message, uint16_t length,
+                         uint8_t sectorCount, bool *trailersChanged);
+    uint8_t readMad(const uint8_t *uid, uint8_t uidLen, uint8_t sectorCount, uint8_t *mad);
+};
+
+#endif
@@ -0,0 +1,467 @@
+
+#include "provisioner.h"
+#include "PN532_debug.h"
+#include "Arduino.h"
+
+#include <string.h>
+
+#define NDEF_TLV_MESSAGE        (0x03)
+#define NDEF_TLV_TERMINATOR     (0xFE)
+
+#define NTAG_CC_MAGIC           (0xE1)
+#define NTAG_CC_READ_ONLY       (0x0F)
+#define NTAG_UL_DATA_SIZE       (0x06)  // CC size of a Mifare Ultralight, 48 bytes
+
+#define CLASSIC_NDEF_SECTORS    (15)    // sectors pointed to by MAD1
+
+static bool isBlank(const uint8_t *data, uint8_t length)
+{
+    while (length--) {
+        if (*data++) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Provisioner::Provisioner(PN532 &nfc, MifareClassicKeys &keys) : _ndef(nfc, keys)
+{
+    _nfc = &nfc;
+    _keys = &keys;
+    _tlvLength = 0;
+    _imageLength = 0;
+    _lock = false;
+    _lastUidLength = 0;
+    resetStats();
+}
+
+void Provisioner::resetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _started = millis();
+}
+
+uint16_t Provisioner::tagsPerMinute()
+{
+    unsigned long elapsed = millis() - _started;
+
+    if (!elapsed) {
+        return 0;
+    }
+
+    return (uint32_t)_stats.tags * 60000UL / elapsed;
+}
+
+uint8_t Provisioner::begin(const uint8_t *message, uint16_t length, bool lock)
+{
+    uint8_t headerLength = (length < 0xFF) ? 2 : 4;
+
+    _tlvLength = headerLength + length + 1;
+    _imageLength = (_tlvLength + MIFARE_CLASSIC_BLOCK_SIZE - 1) & ~(MIFARE_CLASSIC_BLOCK_SIZE - 1);
+    if (_imageLength > PROVISIONER_IMAGE_SIZE ||
+            _imageLength > CLASSIC_NDEF_SECTORS * 3 * MIFARE_CLASSIC_BLOCK_SIZE) {
+        DMSG("NDEF message too large\n");
+        _imageLength = 0;
+        return 0;
+    }
+
+    memset(_image, 0, sizeof(_image));
+    _image[0] = NDEF_TLV_MESSAGE;
+    if (headerLength == 2) {
+        _image[1] = length;
+    } else {
+        _image[1] = 0xFF;
+        _image[2] = length >> 8;
+        _image[3] = length & 0xFF;
+    }
+    memcpy(_image + headerLength, message, length);
+    _image[_tlvLength - 1] = NDEF_TLV_TERMINATOR;
+
+    // MAD1 pointing to the sectors the image spans, from sector 1 on
+    uint8_t sectors = (_imageLength / MIFARE_CLASSIC_BLOCK_SIZE + 2) / 3;
+    memset(_mad, 0, sizeof(_mad));
+    _mad[1] = MIFARE_MAD_INFO_BYTE;
+    for (uint8_t sector = 1; sector <= sectors; sector++) {
+        _mad[2 * sector] = MIFARE_MAD_NDEF_AID_0;
+        _mad[2 * sector + 1] = MIFARE_MAD_NDEF_AID_1;
+    }
+    _mad[0] = MifareClassicNdef::madCrc(_mad + 1, sizeof(_mad) - 1);
+
+    memcpy(_madTrailer, MIFARE_MAD_KEY_A, 6);
+    memcpy(_madTrailer + 6, lock ? MIFARE_MAD_RO_ACCESS : MIFARE_MAD_ACCESS, 4);
+    memcpy(_madTrailer + 10, MIFARE_DEFAULT_KEY_B, 6);
+    memcpy(_ndefTrailer, MIFARE_NDEF_KEY_A, 6);
+    memcpy(_ndefTrailer + 6, lock ? MIFARE_NDEF_RO_ACCESS : MIFARE_NDEF_ACCESS, 4);
+    memcpy(_ndefTrailer + 10, MIFARE_DEFAULT_KEY_B, 6);
+
+    _lock = lock;
+    _lastUidLength = 0;
+
+    return 1;
+}
+
+uint8_t Provisioner::poll(uint16_t timeout)
+{
+    unsigned long start = millis();
+    uint8_t uid[10];
+    uint8_t uidLen;
+
+    if (!_nfc->readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen, timeout, true)) {
+        _lastUidLength = 0;
+        return PROVISION_NO_TAG;
+    }
+
+    // Still the tag of the last tap
+    if (uidLen == _lastUidLength && 0 == memcmp(uid, _lastUid, uidLen)) {
+        return PROVISION_NO_TAG;
+    }
+
+    _stats.detectTime += millis() - start;
+    memcpy(_lastUid, uid, uidLen);
+    _lastUidLength = uidLen;
+
+    return provision(uid, uidLen);
+}
+
+uint8_t Provisioner::provision(const uint8_t *uid, uint8_t uidLen)
+{
+    uint8_t result;
+
+    if (!_imageLength) {
+        return PROVISION_FAILED;
+    }
+
+    switch (_nfc->getSAK()) {
+    case 0x00:
+        result = ntagProvision(uid, uidLen);
+        break;
+    case 0x08:
+    case 0x18:
+        result = classicProvision(uid, uidLen);
+        break;
+    default:
+        result = PROVISION_UNSUPPORTED;
+        break;
+    }
+
+    if (PROVISION_OK == result) {
+        _stats.tags++;
+    } else {
+        _stats.failures++;
+    }
+
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    Sends GET_VERSION.  NTAG21x and Ultralight EV1 answer it and support
+    FAST_READ, the older Ultralights (and Ultralight C) NAK it and go
+    back to IDLE.
+
+    @param  version     receives the 8 bytes of the answer
+*/
+/**************************************************************************/
+uint8_t Provisioner::ntagGetVersion(uint8_t *version)
+{
+    uint8_t command[1] = {NTAG_CMD_GET_VERSION};
+    uint8_t length = 1 + 8;
+
+    return _nfc->inDataExchange(command, sizeof(command), version, &length) && 8 == length;
+}
+
+/**************************************************************************/
+/*!
+    Writes the TLV stream from page 4 on.  The Capability Container must
+    be there already (it is on blank NTAG21x), it tells the data area
+    size.  GET_VERSION tells whether FAST_READ can be used.
+*/
+/**************************************************************************/
+uint8_t Provisioner::ntagProvision(const uint8_t *uid, uint8_t uidLen)
+{
+    uint8_t version[1 + 8];
+    uint8_t command[2] = {MIFARE_CMD_READ, 0};
+    uint8_t header[1 + 16];     // pages 0 to 3, CC in page 3
+    uint8_t length = sizeof(header);
+
+    bool fastRead = ntagGetVersion(version);
+    if (!fastRead && !_nfc->reselectPassiveTarget(uid, uidLen)) {
+        return PROVISION_FAILED;
+    }
+
+    if (!_nfc->inDataExchange(command, sizeof(command), header, &length) || length != 16) {
+        return PROVISION_FAILED;
+    }
+
+    const uint8_t *cc = header + 12;
+    if (cc[0] != NTAG_CC_MAGIC || cc[2] * 8 < _tlvLength) {
+        DMSG("No CC or NDEF message too large\n");
+        return PROVISION_UNSUPPORTED;
+    }
+    if (cc[3] != 0x00) {
+        DMSG("Tag is read-only\n");
+        return PROVISION_FAILED;
+    }
+
+    uint8_t pageCount = (_tlvLength + 3) / 4;
+    unsigned long start = millis();
+    for (uint8_t i = 0; i < pageCount; i++) {
+        if (isBlank(_image + 4 * i, 4)) {
+            continue;
+        }
+        if (!_nfc->mifareultralight_WritePage(4 + i, _image + 4 * i)) {
+            return PROVISION_FAILED;
+        }
+        _stats.units++;
+    }
+    _stats.writeTime += millis() - start;
+
+    start = millis();
+    uint8_t verified = ntagVerify(fastRead ? PROVISIONER_VERIFY_PAGES : 4, pageCount);
+    _stats.verifyTime += millis() - start;
+    if (!verified) {
+        return PROVISION_FAILED;
+    }
+
+    if (_lock) {
+        start = millis();
+        verified = ntagLock(header, fastRead ? version : 0);
+        _stats.lockTime += millis() - start;
+        if (!verified) {
+            return PROVISION_FAILED;
+        }
+    }
+
+    return PROVISION_OK;
+}
+
+/**************************************************************************/
+/*!
+    Reads the image back, burst pages at once (FAST_READ, or READ for 4
+    pages), and writes the differing pages again once
+*/
+/**************************************************************************/
+uint8_t Provisioner::ntagVerify(uint8_t burst, uint8_t pageCount)
+{
+    uint8_t data[1 + 4 * PROVISIONER_VERIFY_PAGES];
+
+    for (uint8_t first = 0; first < pageCount; first += burst) {
+        uint8_t count = (pageCount - first < burst) ? pageCount - first : burst;
+
+        for (uint8_t pass = 0; ; pass++) {
+            uint8_t command[3] = {NTAG_CMD_FAST_READ, (uint8_t)(4 + first), (uint8_t)(4 + first + count - 1)};
+            uint8_t length = sizeof(data);
+
+            if (4 == burst) {
+                command[0] = MIFARE_CMD_READ;
+            }
+            if (!_nfc->inDataExchange(command, (4 == burst) ? 2 : 3, data, &length) || length < 4 * count) {
+                return 0;
+            }
+
+            uint8_t differing = 0;
+            for (uint8_t i = 0; i < count; i++) {
+                const uint8_t *page = _image + 4 * (first + i);
+                if (memcmp(data + 4 * i, page, 4)) {
+                    differing++;
+                    if (pass || !_nfc->mifareultralight_WritePage(4 + first + i, (uint8_t *)page)) {
+                        DMSG("Verification failed on page ");
+                        DMSG_INT(4 + first + i);
+                        DMSG("\n");
+                        return 0;
+                    }
+                    _stats.rewrites++;
+                }
+            }
+            if (!differing) {
+                break;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Makes an NTAG21x read-only: CC write access, then the dynamic lock
+    bytes (found from GET_VERSION) and the static lock bytes, which also
+    lock the CC
+
+    @param  version     answer to GET_VERSION, 0 if the tag has none
+*/
+/**************************************************************************/
+uint8_t Provisioner::ntagLock(const uint8_t *header, const uint8_t *version)
+{
+    uint8_t page[4];
+    uint8_t dynamicLock = 0;
+
+    if (header[14] > NTAG_UL_DATA_SIZE) {
+        switch (version ? version[6] : 0) {
+        case 0x0F:  // NTAG213
+            dynamicLock = 0x28;
+            break;
+        case 0x11:  // NTAG215
+            dynamicLock = 0x82;
+            break;
+        case 0x13:  // NTAG216
+            dynamicLock = 0xE2;
+            break;
+        default:
+            DMSG("Unknown dynamic lock bytes\n");
+            return 0;
+        }
+    }
+
+    memcpy(page, header + 12, 3);
+    page[3] = NTAG_CC_READ_ONLY;
+    if (!_nfc->mifareultralight_WritePage(3, page)) {
+        return 0;
+    }
+
+    if (dynamicLock) {
+        page[0] = page[1] = page[2] = 0xFF;
+        page[3] = 0x00;
+        if (!_nfc->mifareultralight_WritePage(dynamicLock, page)) {
+            return 0;
+        }
+    }
+
+    // Bytes 0 and 1 of page 2 are not written
+    page[0] = page[1] = 0x00;
+    page[2] = page[3] = 0xFF;
+
+    return _nfc->mifareultralight_WritePage(2, page);
+}
+
+uint8_t Provisioner::classicWrite(uint8_t block, uint8_t *data)
+{
+    if (isBlank(data, MIFARE_CLASSIC_BLOCK_SIZE)) {
+        return 1;
+    }
+
+    _stats.units++;
+
+    return _nfc->mifareclassic_WriteDataBlock(block, data);
+}
+
+/**************************************************************************/
+/*!
+    Reads a block back and writes it again once if it differs
+*/
+/**************************************************************************/
+uint8_t Provisioner::classicVerify(uint8_t block, uint8_t *data)
+{
+    uint8_t current[MIFARE_CLASSIC_BLOCK_SIZE];
+
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        if (!_nfc->mifareclassic_ReadDataBlock(block, current)) {
+            return 0;
+        }
+        if (0 == memcmp(current, data, MIFARE_CLASSIC_BLOCK_SIZE)) {
+            return 1;
+        }
+        if (pass || !_nfc->mifareclassic_WriteDataBlock(block, data)) {
+            break;
+        }
+        _stats.rewrites++;
+    }
+
+    DMSG("Verification failed on block ");
+    DMSG_INT(block);
+    DMSG("\n");
+
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    Writes a sector trailer unless the sector has the target access bits
+    already, and checks the access bits read back
+*/
+/**************************************************************************/
+uint8_t Provisioner::classicTrailer(uint8_t block, const uint8_t *current, uint8_t *target)
+{
+    uint8_t trailer[MIFARE_CLASSIC_BLOCK_SIZE];
+
+    if (0 == memcmp(current + 6, target + 6, 4)) {
+        return 1;
+    }
+
+    unsigned long start = millis();
+    uint8_t result = _nfc->mifareclassic_WriteDataBlock(block, target) &&
+                     _nfc->mifareclassic_ReadDataBlock(block, trailer) &&
+                     0 == memcmp(trailer + 6, target + 6, 4);
+    if (_lock) {
+        _stats.lockTime += millis() - start;
+    } else {
+        _stats.writeTime += millis() - start;
+    }
+    _stats.units++;
+
+    return result;
+}
+
+/**************************************************************************/
+/*!
+    Provisions the blocks of one sector: authentication, data blocks
+    written then read back, trailer last
+*/
+/**************************************************************************/
+uint8_t Provisioner::classicSectorImage(const uint8_t *uid, uint8_t uidLen, uint8_t sector, uint8_t firstBlock,
+                                        uint8_t *data, uint8_t count, uint8_t *targetTrailer)
+{
+    uint8_t trailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t sectorFirst = PN532::mifareclassic_SectorFirstBlock(sector);
+
+    if (!_ndef.prepareSector(uid, uidLen, sector, firstBlock - sectorFirst, targetTrailer + 6, trailer)) {
+        return 0;
+    }
+
+    unsigned long start = millis();
+    for (uint8_t i = 0; i < count; i++) {
+        if (!classicWrite(firstBlock + i, data + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+            return 0;
+        }
+    }
+    _stats.writeTime += millis() - start;
+
+    start = millis();
+    for (uint8_t i = 0; i < count; i++) {
+        if (!classicVerify(firstBlock + i, data + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+            return 0;
+        }
+    }
+    _stats.verifyTime += millis() - start;
+
+    return classicTrailer(sectorFirst + 3, trailer, targetTrailer);
+}
+
+/**************************************************************************/
+/*!
+    Writes the image to sectors 1 and on, then the MAD, as
+    MifareClassicNdef::write does
+*/
+/**************************************************************************/
+uint8_t Provisioner::classicProvision(const uint8_t *uid, uint8_t uidLen)
+{
+    uint8_t blockCount = _imageLength / MIFARE_CLASSIC_BLOCK_SIZE;
+    uint8_t result = 1;
+
+    for (uint8_t sector = 1, index = 0; result && index < blockCount; sector++, index += 3) {
+        uint8_t count = (blockCount - index < 3) ? blockCount - index : 3;
+
+        result = classicSectorImage(uid, uidLen, sector, PN532::mifareclassic_SectorFirstBlock(sector),
+                                    _image + index * MIFARE_CLASSIC_BLOCK_SIZE, count, _ndefTrailer);
+    }
+
+    if (result) {
+        result = classicSectorImage(uid, uidLen, MIFARE_MAD_SECTOR, 1, _mad, 2, _madTrailer);
+    }
+
+    // The keys of the card changed
+    _keys->forget(uid, uidLen);
+
+    return result ? PROVISION_OK : PROVISION_FAILED;
+}
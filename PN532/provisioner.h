@@ -0,0 +1,119 @@
+/**************************************************************************/
+/*!
+    @file     provisioner.h
+    @license  BSD
+
+    Writes the same NDEF message onto a run of NTAG21x / Ultralight and
+    Mifare Classic 1K/4K tags.  The message is encoded once: the TLV
+    stream for both families, the MAD and the sector trailers for
+    Classic.  Each tag gets only the pages or blocks that differ from a
+    blank tag, is checked with bulk reads (the differing pages or blocks
+    are written again once) and may then be locked read-only.
+*/
+/**************************************************************************/
+
+#ifndef __PROVISIONER_H__
+#define __PROVISIONER_H__
+
+#include "PN532.h"
+#include "mifareclassic_keys.h"
+#include "mifareclassic_ndef.h"
+
+#ifndef PROVISIONER_IMAGE_SIZE
+#define PROVISIONER_IMAGE_SIZE      144     // longest TLV stream, multiple of 16 (NTAG213: 144)
+#endif
+
+#define PROVISIONER_VERIFY_PAGES    (16)    // pages per FAST_READ
+
+// Results of poll and provision
+#define PROVISION_NO_TAG            (0)     // no new tag on the reader
+#define PROVISION_OK                (1)     // written, verified and locked if asked
+#define PROVISION_FAILED            (2)
+#define PROVISION_UNSUPPORTED       (3)     // not an NTAG/Ultralight or Classic, or too small
+
+#define NTAG_CMD_GET_VERSION        (0x60)
+#define NTAG_CMD_FAST_READ          (0x3A)
+
+typedef struct {
+    uint16_t tags;          // provisioned and verified
+    uint16_t failures;      // tags that failed or are unsupported
+    uint16_t units;         // pages or blocks written
+    uint16_t rewrites;      // pages or blocks written again after verification
+    uint32_t detectTime;    // ms spent in each step, all tags together
+    uint32_t writeTime;
+    uint32_t verifyTime;
+    uint32_t lockTime;      // Classic: sector trailers of a locked run
+} provisioner_stats_t;
+
+class Provisioner {
+public:
+    /**
+    * @param    nfc     PN532 the tags are inlisted on
+    * @param    keys    dictionary for Classic cards, with the transport
+    *                   key 0xFF.. (and the MAD and NDEF keys to provision
+    *                   formatted cards again)
+    */
+    Provisioner(PN532 &nfc, MifareClassicKeys &keys);
+
+    /**
+    * @brief    encode the message for the run
+    * @param    message     NDEF message (without TLV)
+    * @param    length      length of the message
+    * @param    lock        make each tag read-only once verified
+    * @return   1           success
+    *           0           the message is longer than PROVISIONER_IMAGE_SIZE
+    *                       or 15 Classic sectors allow
+    */
+    uint8_t begin(const uint8_t *message, uint16_t length, bool lock = false);
+
+    /**
+    * @brief    look for a tag and provision it, once per tap
+    * @param    timeout     time to wait for a tag, in ms
+    * @return   PROVISION_NO_TAG if no tag arrived, otherwise the result
+    *           of provision
+    */
+    uint8_t poll(uint16_t timeout = 100);
+
+    /**
+    * @brief    provision the inlisted tag, the family is given by its SAK
+    * @param    uid         uid of the tag
+    * @param    uidLen      length of the uid
+    * @return   PROVISION_OK, PROVISION_FAILED or PROVISION_UNSUPPORTED
+    */
+    uint8_t provision(const uint8_t *uid, uint8_t uidLen);
+
+    const provisioner_stats_t &stats() { return _stats; };
+    void resetStats();
+
+    // tags provisioned per minute since resetStats
+    uint16_t tagsPerMinute();
+
+private:
+    uint8_t ntagGetVersion(uint8_t *version);
+    uint8_t ntagProvision(const uint8_t *uid, uint8_t uidLen);
+    uint8_t ntagVerify(uint8_t burst, uint8_t pageCount);
+    uint8_t ntagLock(const uint8_t *header, const uint8_t *version);
+    uint8_t classicProvision(const uint8_t *uid, uint8_t uidLen);
+    uint8_t classicSectorImage(const uint8_t *uid, uint8_t uidLen, uint8_t sector, uint8_t firstBlock,
+                               uint8_t *data, uint8_t count, uint8_t *targetTrailer);
+    uint8_t classicWrite(uint8_t block, uint8_t *data);
+    uint8_t classicVerify(uint8_t block, uint8_t *data);
+    uint8_t classicTrailer(uint8_t block, const uint8_t *current, uint8_t *target);
+
+    PN532 *_nfc;
+    MifareClassicKeys *_keys;
+    MifareClassicNdef _ndef;                    // prepares the Classic sectors
+    uint8_t _image[PROVISIONER_IMAGE_SIZE];     // TLV stream, zero padded
+    uint16_t _tlvLength;
+    uint16_t _imageLength;                      // multiple of 16
+    uint8_t _mad[2 * MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t _madTrailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t _ndefTrailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    bool _lock;
+    uint8_t _lastUid[10];
+    uint8_t _lastUidLength;     // 0 when the reader is empty
+    provisioner_stats_t _stats;
+    unsigned long _started;
+};
+
+#endif
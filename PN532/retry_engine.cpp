@@ -0,0 +1,204 @@
+
+#include "retry_engine.h"
+#include "PN532_debug.h"
+#include "Arduino.h"
+
+#include <string.h>
+
+// Default policies, tuned for a card held by hand over the antenna
+static const retry_policy_t defaultPolicies[RETRY_CLASSES] = {
+    { 2, 2, 0, 0, 200 },        // RETRY_CLASS_AUTH
+    { 3, 3, 2, 20, 300 },       // RETRY_CLASS_READ
+    { 2, 2, 5, 20, 300 },       // RETRY_CLASS_WRITE
+    { 2, 0, 5, 50, 500 },       // RETRY_CLASS_EXCHANGE
+};
+
+RetryEngine::RetryEngine(PN532 &nfc)
+{
+    _nfc = &nfc;
+    memcpy(_policies, defaultPolicies, sizeof(_policies));
+    resetStats();
+}
+
+void RetryEngine::resetStats()
+{
+    memset(_stats, 0, sizeof(_stats));
+}
+
+/**************************************************************************/
+/*!
+    Tells how to recover from a failure
+
+    @param  status        Status of the failed command
+
+    @returns RETRY_TRANSIENT, RETRY_RESELECT or RETRY_PERMANENT
+*/
+/**************************************************************************/
+uint8_t RetryEngine::classify(pn532_status_t status)
+{
+    switch (status.transport) {
+    case 0:
+        break;
+    case PN532_TIMEOUT:
+    case PN532_INVALID_FRAME:
+    case PN532_INVALID_ACK:
+        return RETRY_TRANSIENT;
+    default:    // PN532_NO_SPACE, PN532_CANCELLED
+        return RETRY_PERMANENT;
+    }
+
+    switch (status.error) {
+    case PN532_ERROR_TIMEOUT:
+    case PN532_ERROR_CRC:
+    case PN532_ERROR_PARITY:
+    case PN532_ERROR_BIT_COUNT:
+    case PN532_ERROR_FRAMING:
+    case PN532_ERROR_COLLISION:
+    case PN532_ERROR_RF_BUFFER_OVERFLOW:
+    case PN532_ERROR_RF_PROTOCOL:
+    case PN532_ERROR_INTERNAL_OVERFLOW:
+        return RETRY_TRANSIENT;
+    case PN532_ERROR_MIFARE_AUTH:
+    case PN532_ERROR_CONTEXT:
+    case PN532_ERROR_RELEASED:
+        return RETRY_RESELECT;
+    default:    // no error from the PN532: the card refused the operation
+        return RETRY_PERMANENT;
+    }
+}
+
+uint8_t RetryEngine::run(uint8_t opClass, retryOperation operation, void *context,
+                         const uint8_t *uid, uint8_t uidLen, bool stateless)
+{
+    const retry_policy_t *policy = &_policies[opClass];
+    retry_stats_t *stats = &_stats[opClass];
+    unsigned long start = millis();
+    uint16_t backoff = policy->backoff;
+    uint8_t reselects = 0;
+
+    stats->calls++;
+
+    for (uint8_t attempt = 0; ; attempt++) {
+        if (operation(*_nfc, context)) {
+            return 1;
+        }
+
+        uint8_t recovery = classify(_nfc->getStatus());
+        if (RETRY_TRANSIENT == recovery && !stateless) {
+            recovery = RETRY_RESELECT;
+        }
+
+        if (RETRY_PERMANENT == recovery || attempt == policy->maxRetries) {
+            break;
+        }
+        if (RETRY_RESELECT == recovery && (!uid || reselects == policy->maxReselects)) {
+            break;
+        }
+        if (policy->budget && millis() - start + backoff >= policy->budget) {
+            DMSG("Retry budget exhausted\n");
+            break;
+        }
+
+        if (backoff) {
+            delay(backoff);
+            backoff = (backoff > policy->maxBackoff / 2) ? policy->maxBackoff : backoff * 2;
+        }
+
+        stats->retries++;
+        if (RETRY_RESELECT == recovery) {
+            reselects++;
+            stats->reselects++;
+            if (!_nfc->reselectPassiveTarget(uid, uidLen)) {
+                DMSG("Card gone\n");
+                break;
+            }
+        }
+    }
+
+    stats->failures++;
+    return 0;
+}
+
+struct BlockAccess {
+    const uint8_t *uid;
+    uint8_t uidLen;
+    uint8_t blockNumber;
+    uint8_t keyNumber;
+    const uint8_t *keyData;
+    uint8_t *data;
+};
+
+static uint8_t authenticateBlock(PN532 &nfc, void *context)
+{
+    BlockAccess *access = (BlockAccess *)context;
+
+    return nfc.mifareclassic_AuthenticateSector(access->uid, access->uidLen,
+                                                PN532::mifareclassic_BlockToSector(access->blockNumber),
+                                                access->keyNumber, access->keyData);
+}
+
+static uint8_t readBlock(PN532 &nfc, void *context)
+{
+    BlockAccess *access = (BlockAccess *)context;
+
+    return nfc.mifareclassic_AuthenticateSector(access->uid, access->uidLen,
+                                                PN532::mifareclassic_BlockToSector(access->blockNumber),
+                                                access->keyNumber, access->keyData) &&
+           nfc.mifareclassic_ReadDataBlock(access->blockNumber, access->data);
+}
+
+static uint8_t writeBlock(PN532 &nfc, void *context)
+{
+    BlockAccess *access = (BlockAccess *)context;
+
+    return nfc.mifareclassic_AuthenticateSector(access->uid, access->uidLen,
+                                                PN532::mifareclassic_BlockToSector(access->blockNumber),
+                                                access->keyNumber, access->keyData) &&
+           nfc.mifareclassic_WriteDataBlock(access->blockNumber, access->data);
+}
+
+static uint8_t readPage(PN532 &nfc, void *context)
+{
+    BlockAccess *access = (BlockAccess *)context;
+
+    return nfc.mifareultralight_ReadPage(access->blockNumber, access->data);
+}
+
+static uint8_t writePage(PN532 &nfc, void *context)
+{
+    BlockAccess *access = (BlockAccess *)context;
+
+    return nfc.mifareultralight_WritePage(access->blockNumber, access->data);
+}
+
+uint8_t RetryEngine::mifareclassic_ReadDataBlock(const uint8_t *uid, uint8_t uidLen, uint8_t blockNumber,
+                                                 uint8_t keyNumber, const uint8_t *keyData, uint8_t *data)
+{
+    BlockAccess access = {uid, uidLen, blockNumber, keyNumber, keyData, data};
+
+    return run(RETRY_CLASS_AUTH, authenticateBlock, &access, uid, uidLen, false) &&
+           run(RETRY_CLASS_READ, readBlock, &access, uid, uidLen, false);
+}
+
+uint8_t RetryEngine::mifareclassic_WriteDataBlock(const uint8_t *uid, uint8_t uidLen, uint8_t blockNumber,
+                                                  uint8_t keyNumber, const uint8_t *keyData, const uint8_t *data)
+{
+    BlockAccess access = {uid, uidLen, blockNumber, keyNumber, keyData, (uint8_t *)data};
+
+    return run(RETRY_CLASS_AUTH, authenticateBlock, &access, uid, uidLen, false) &&
+           run(RETRY_CLASS_WRITE, writeBlock, &access, uid, uidLen, false);
+}
+
+uint8_t RetryEngine::mifareultralight_ReadPage(const uint8_t *uid, uint8_t uidLen, uint8_t page, uint8_t *buffer)
+{
+    BlockAccess access = {uid, uidLen, page, 0, 0, buffer};
+
+    return run(RETRY_CLASS_READ, readPage, &access, uid, uidLen, false);
+}
+
+uint8_t RetryEngine::mifareultralight_WritePage(const uint8_t *uid, uint8_t uidLen, uint8_t page, const uint8_t *buffer)
+{
+    BlockAccess access = {uid, uidLen, page, 0, 0, (uint8_t *)buffer};
+
+    return run(RETRY_CLASS_WRITE, writePage, &access, uid, uidLen, false);
+}
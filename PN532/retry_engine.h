@@ -0,0 +1,95 @@
+/**************************************************************************/
+/*!
+    @file     retry_engine.h
+    @license  BSD
+
+    Retries single card operations by policy.  The status of a failed
+    operation (see PN532::getStatus) tells whether to retry it as is
+    (RF glitch), to re-select the card first (authentication lost) or
+    to give up at once (wrong parameters, card swapped).
+*/
+/**************************************************************************/
+
+#ifndef __RETRY_ENGINE_H__
+#define __RETRY_ENGINE_H__
+
+#include "PN532.h"
+
+// Operation classes, each with its own policy and counters
+#define RETRY_CLASS_AUTH            (0)
+#define RETRY_CLASS_READ            (1)
+#define RETRY_CLASS_WRITE           (2)
+#define RETRY_CLASS_EXCHANGE        (3)     // APDUs and other raw exchanges
+#define RETRY_CLASSES               (4)
+
+// What to do after a failure, see RetryEngine::classify
+#define RETRY_TRANSIENT             (0)     // retry the same exchange
+#define RETRY_RESELECT              (1)     // re-select the card, then retry
+#define RETRY_PERMANENT             (2)     // fail now
+
+typedef struct {
+    uint8_t maxRetries;     // retries after the first attempt
+    uint8_t maxReselects;   // re-selections among those retries
+    uint16_t backoff;       // ms before the first retry, doubled after each one
+    uint16_t maxBackoff;    // ms, bound of the backoff
+    uint16_t budget;        // ms for all attempts, 0 for no limit
+} retry_policy_t;
+
+typedef struct {
+    uint16_t calls;
+    uint16_t retries;
+    uint16_t reselects;
+    uint16_t failures;      // calls that failed in the end
+} retry_stats_t;
+
+// One attempt of an operation: returns 1 if it succeeded
+typedef uint8_t (*retryOperation)(PN532 &nfc, void *context);
+
+class RetryEngine {
+public:
+    RetryEngine(PN532 &nfc);
+
+    void setPolicy(uint8_t opClass, const retry_policy_t *policy) { _policies[opClass] = *policy; };
+    const retry_policy_t *getPolicy(uint8_t opClass) { return &_policies[opClass]; };
+
+    /**
+    * @brief    run an operation, retrying it by the policy of its class
+    * @param    opClass     RETRY_CLASS_xxx
+    * @param    operation   one attempt of the operation
+    * @param    context     passed to the operation
+    * @param    uid         uid of the card to re-select, 0 to never re-select
+    * @param    uidLen      length of the uid
+    * @param    stateless   false if the card drops its state after any
+    *                       error (Mifare Classic), every retry then
+    *                       re-selects it
+    * @return   1 if an attempt succeeded, 0 otherwise
+    */
+    uint8_t run(uint8_t opClass, retryOperation operation, void *context,
+                const uint8_t *uid = 0, uint8_t uidLen = 0, bool stateless = true);
+
+    // Mifare Classic block access: the sector is authenticated under
+    // RETRY_CLASS_AUTH, then a failed block is retried after re-selecting
+    // the card and authenticating its sector again, the blocks done
+    // before it are not
+    uint8_t mifareclassic_ReadDataBlock(const uint8_t *uid, uint8_t uidLen, uint8_t blockNumber,
+                                        uint8_t keyNumber, const uint8_t *keyData, uint8_t *data);
+    uint8_t mifareclassic_WriteDataBlock(const uint8_t *uid, uint8_t uidLen, uint8_t blockNumber,
+                                         uint8_t keyNumber, const uint8_t *keyData, const uint8_t *data);
+
+    // Mifare Ultralight / Type 2 page access: the tag goes back to IDLE
+    // after a NAK or a garbled frame, so every retry re-selects it
+    uint8_t mifareultralight_ReadPage(const uint8_t *uid, uint8_t uidLen, uint8_t page, uint8_t *buffer);
+    uint8_t mifareultralight_WritePage(const uint8_t *uid, uint8_t uidLen, uint8_t page, const uint8_t *buffer);
+
+    static uint8_t classify(pn532_status_t status);
+
+    const retry_stats_t *stats(uint8_t opClass) { return &_stats[opClass]; };
+    void resetStats();
+
+private:
+    PN532 *_nfc;
+    retry_policy_t _policies[RETRY_CLASSES];
+    retry_stats_t _stats[RETRY_CLASSES];
+};
+
+#endif
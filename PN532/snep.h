@@ -15,7 +15,7 @@
 
 class SNEP {
 public:
-	SNEP(PN532Interface &interface) : llcp(interface) {
+	SNEP(PN532Transport &interface, PN532_BUFFER_ARGS) : llcp(interface, buffer, size) {
 		headerBuf = llcp.getHeaderBuffer(&headerBufLen);
 	};
 
@@ -40,6 +40,11 @@ public:
     */
     int16_t read(uint8_t *buf, uint8_t len, uint16_t timeout = 0);
 
+    // outcome of the last PN532 command, see PN532::getStatus
+    pn532_status_t getStatus() {
+        return llcp.getStatus();
+    };
+
 private:
 	LLCP llcp;
 	uint8_t *headerBuf;
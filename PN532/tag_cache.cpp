@@ -0,0 +1,433 @@
+
+#include "tag_cache.h"
+#include "PN532_debug.h"
+
+#include <string.h>
+
+// FNV-1a, enough to tell a trailer or a message apart
+static uint32_t hash(uint32_t h, const uint8_t *data, uint16_t length)
+{
+    while (length--) {
+        h = (h ^ *data++) * 16777619UL;
+    }
+
+    return h;
+}
+
+#define HASH_INIT   (2166136261UL)
+
+TagCache::TagCache(PN532 &nfc)
+{
+    _nfc = &nfc;
+    clear();
+}
+
+void TagCache::clear()
+{
+    for (uint8_t i = 0; i < TAG_CACHE_ENTRIES; i++) {
+        _entries[i].uidLength = 0;
+    }
+    _clock = 0;
+    _hits = 0;
+    _misses = 0;
+}
+
+tag_cache_entry_t *TagCache::lookup(const uint8_t *uid, uint8_t uidLen, uint8_t family, uint8_t index)
+{
+    if (uidLen > sizeof(_entries[0].uid)) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < TAG_CACHE_ENTRIES; i++) {
+        tag_cache_entry_t *entry = &_entries[i];
+        if (entry->uidLength == uidLen && entry->family == family && entry->index == index &&
+                0 == memcmp(entry->uid, uid, uidLen)) {
+            entry->used = ++_clock;
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    Gives the entry to fill for a tag: the stale one if any, else a free
+    one, else the least recently used
+*/
+/**************************************************************************/
+tag_cache_entry_t *TagCache::store(tag_cache_entry_t *entry, const uint8_t *uid, uint8_t uidLen, uint8_t family, uint8_t index)
+{
+    if (uidLen > sizeof(entry->uid)) {
+        return 0;
+    }
+
+    if (!entry) {
+        entry = &_entries[0];
+        for (uint8_t i = 0; i < TAG_CACHE_ENTRIES && entry->uidLength; i++) {
+            if (!_entries[i].uidLength ||
+                    (uint16_t)(_clock - _entries[i].used) > (uint16_t)(_clock - entry->used)) {
+                entry = &_entries[i];
+            }
+        }
+    }
+
+    // Not valid until the content is read in full
+    entry->uidLength = 0;
+    memcpy(entry->uid, uid, uidLen);
+    entry->family = family;
+    entry->index = index;
+    entry->used = ++_clock;
+
+    return entry;
+}
+
+/**************************************************************************/
+/*!
+    Reads the NFC counter of an NTAG21x, which needs NFC_CNT_EN set in
+    the configuration pages of the tag
+*/
+/**************************************************************************/
+bool TagCache::ntagCounter(uint32_t *counter)
+{
+    uint8_t command[] = {NTAG_CMD_READ_CNT, NTAG_NFC_COUNTER};
+    uint8_t response[4];
+    uint8_t length = sizeof(response);
+
+    if (!_nfc->inDataExchange(command, sizeof(command), response, &length) || length != 3) {
+        DMSG_STR("No NFC counter");
+        return false;
+    }
+
+    *counter = (uint32_t)response[2] << 16 | (uint32_t)response[1] << 8 | response[0];
+
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Reads the NDEF message TLV of an NTAG21x, 4 pages per READ from page
+    4.  The message must start in the first 16 bytes, after the NULL,
+    Lock Control and Memory Control TLVs.
+*/
+/**************************************************************************/
+bool TagCache::ntagRead(tag_cache_entry_t *entry)
+{
+    uint8_t command[2] = {MIFARE_CMD_READ, 4};
+    uint8_t data[1 + 16];
+    uint8_t length = sizeof(data);
+
+    if (!_nfc->inDataExchange(command, sizeof(command), data, &length) || length != 16) {
+        return false;
+    }
+
+    uint16_t i = 0;
+    while (i < 16 && 0x03 != data[i]) {
+        if (0x00 == data[i]) {
+            i++;
+        } else if ((0x01 == data[i] || 0x02 == data[i]) && i + 1 < 16 && i + 2 + data[i + 1] <= 16) {
+            i += 2 + data[i + 1];
+        } else {
+            DMSG_STR("No NDEF message TLV");
+            return false;
+        }
+    }
+
+    uint16_t total;
+    if (i + 1 < 16 && 0xFF != data[i + 1]) {
+        total = data[i + 1];
+        i += 2;
+    } else if (i + 3 < 16) {
+        total = data[i + 2] << 8 | data[i + 3];
+        i += 4;
+    } else {
+        DMSG_STR("No NDEF message TLV");
+        return false;
+    }
+
+    if (total > TAG_CACHE_CONTENT_SIZE) {
+        DMSG_STR("NDEF message too long to cache");
+        return false;
+    }
+
+    entry->length = total;
+    for (uint16_t offset = 0; ; ) {
+        uint8_t chunk = (total - offset < 16 - i) ? total - offset : 16 - i;
+        memcpy(entry->content + offset, data + i, chunk);
+        offset += chunk;
+        if (offset == total) {
+            break;
+        }
+
+        command[1] += 4;
+        length = sizeof(data);
+        if (!_nfc->inDataExchange(command, sizeof(command), data, &length) || length != 16) {
+            return false;
+        }
+        i = 0;
+    }
+
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Gives the NDEF message of the inlisted NTAG21x.  A cached message is
+    used if the NFC counter didn't move since it was read: 1 exchange.
+
+    @param  uid         Uid of the tag
+    @param  uidLen      Length of the uid
+    @param  length      Length of the message (out)
+
+    @returns the message, valid until the next call, 0 for an error
+*/
+/**************************************************************************/
+const uint8_t *TagCache::ntag_ReadNDEF(const uint8_t *uid, uint8_t uidLen, uint16_t *length)
+{
+    tag_cache_entry_t *entry = lookup(uid, uidLen, TAG_CACHE_NTAG, 0);
+
+    if (entry) {
+        // A NAK sends the tag back to idle, no full read without a new select
+        uint32_t counter;
+        if (!ntagCounter(&counter)) {
+            return 0;
+        }
+        if (counter == entry->check) {
+            _hits++;
+            *length = entry->length;
+            return entry->content;
+        }
+    }
+
+    _misses++;
+    entry = store(entry, uid, uidLen, TAG_CACHE_NTAG, 0);
+    if (!entry || !ntagRead(entry)) {
+        return 0;
+    }
+
+    // Read after the message, the counter includes this session
+    *length = entry->length;
+    if (ntagCounter(&entry->check)) {
+        entry->uidLength = uidLen;
+    }
+
+    return entry->content;
+}
+
+/**************************************************************************/
+/*!
+    Reads the sector trailer, key A masked by the card, and sums it up
+*/
+/**************************************************************************/
+bool TagCache::classicTrailer(uint8_t sectorNumber, uint32_t *checksum)
+{
+    uint8_t trailer[MIFARE_CLASSIC_BLOCK_SIZE];
+    uint8_t block = PN532::mifareclassic_SectorFirstBlock(sectorNumber) +
+                    PN532::mifareclassic_SectorBlockCount(sectorNumber) - 1;
+
+    if (!_nfc->mifareclassic_ReadDataBlock(block, trailer)) {
+        return false;
+    }
+
+    *checksum = hash(HASH_INIT, trailer, sizeof(trailer));
+
+    return true;
+}
+
+bool TagCache::classicRead(tag_cache_entry_t *entry, uint8_t sectorNumber)
+{
+    uint8_t firstBlock = PN532::mifareclassic_SectorFirstBlock(sectorNumber);
+    uint8_t dataBlocks = PN532::mifareclassic_SectorBlockCount(sectorNumber) - 1;
+
+    for (uint8_t i = 0; i < dataBlocks; i++) {
+        if (!_nfc->mifareclassic_ReadDataBlock(firstBlock + i, entry->content + i * MIFARE_CLASSIC_BLOCK_SIZE)) {
+            return false;
+        }
+    }
+    entry->length = dataBlocks * MIFARE_CLASSIC_BLOCK_SIZE;
+
+    return classicTrailer(sectorNumber, &entry->check);
+}
+
+/**************************************************************************/
+/*!
+    Gives the data blocks of a Mifare Classic sector, trailer excluded.
+    Cached blocks are used if the sector trailer didn't change: 2
+    exchanges (authentication and trailer).  Data blocks aren't covered,
+    so a writer of the sector must also change its trailer, e.g. bump
+    the GPB byte.
+
+    @param  uid             Uid of the card
+    @param  uidLen          Length of the uid
+    @param  sectorNumber    The sector
+    @param  keyNumber       0 for key A, 1 for key B
+    @param  keyData         The 6 bytes key
+    @param  length          Length of the blocks (out)
+
+    @returns the blocks, valid until the next call, 0 for an error or a
+             sector longer than TAG_CACHE_CONTENT_SIZE
+*/
+/**************************************************************************/
+const uint8_t *TagCache::mifareclassic_ReadSector(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                                                  uint8_t keyNumber, const uint8_t *keyData, uint16_t *length)
+{
+    if ((PN532::mifareclassic_SectorBlockCount(sectorNumber) - 1) * MIFARE_CLASSIC_BLOCK_SIZE > TAG_CACHE_CONTENT_SIZE) {
+        DMSG_STR("Sector too long to cache");
+        return 0;
+    }
+
+    if (!_nfc->mifareclassic_AuthenticateSector(uid, uidLen, sectorNumber, keyNumber, keyData)) {
+        return 0;
+    }
+
+    tag_cache_entry_t *entry = lookup(uid, uidLen, TAG_CACHE_CLASSIC, sectorNumber);
+
+    if (entry) {
+        // The card drops the authentication after an error
+        uint32_t checksum;
+        if (!classicTrailer(sectorNumber, &checksum)) {
+            return 0;
+        }
+        if (checksum == entry->check) {
+            _hits++;
+            *length = entry->length;
+            return entry->content;
+        }
+    }
+
+    _misses++;
+    entry = store(entry, uid, uidLen, TAG_CACHE_CLASSIC, sectorNumber);
+    if (!entry || !classicRead(entry, sectorNumber)) {
+        return 0;
+    }
+
+    entry->uidLength = uidLen;
+    *length = entry->length;
+
+    return entry->content;
+}
+
+/**************************************************************************/
+/*!
+    Hashes NLEN and the first bytes of the message of a cached NDEF
+    file, with one READ BINARY.  The NDEF application must be selected.
+*/
+/**************************************************************************/
+bool TagCache::type4Probe(const tag_cache_entry_t *entry, uint32_t *check)
+{
+    uint8_t probe[2 + TAG_CACHE_TYPE4_PROBE];
+
+    if (!_nfc->type4_select_ndef(entry->fileId)) {
+        return false;
+    }
+
+    // Same span as when cached: a new NLEN changes the hash anyway
+    uint8_t le = 2 + (entry->length < TAG_CACHE_TYPE4_PROBE ? entry->length : TAG_CACHE_TYPE4_PROBE);
+    if (le != _nfc->type4_read_binary(0, le, probe)) {
+        return false;
+    }
+
+    *check = hash(HASH_INIT, probe, le);
+
+    return true;
+}
+
+bool TagCache::type4Read(tag_cache_entry_t *entry)
+{
+    uint8_t cc[TYPE4_CC_SIZE];
+    uint16_t ccLength;
+    type4_cc_t params;
+
+    if (!_nfc->type4_select_cc() || !_nfc->type4_read_cc(&ccLength, cc, sizeof(cc)) || !PN532::type4_parse_cc(cc, &params)) {
+        return false;
+    }
+
+    if (cc[2] >> 4 != TYPE4_MAPPING_MAJOR) {
+        DMSG_STR("Mapping version not implemented");
+        return false;
+    }
+
+    if (params.readAccess != 0x00) {
+        DMSG_STR("File isn't readable");
+        return false;
+    }
+
+    if (!_nfc->type4_select_ndef(params.fileId)) {
+        return false;
+    }
+
+    uint8_t nlen[2];
+    if (2 != _nfc->type4_read_binary(0, 2, nlen)) {
+        return false;
+    }
+
+    uint16_t total = nlen[0] << 8 | nlen[1];
+    if (total > TAG_CACHE_CONTENT_SIZE) {
+        DMSG_STR("NDEF message too long to cache");
+        return false;
+    }
+
+    uint8_t chunk;
+    _nfc->getBuffer(&chunk);
+    if (params.mle && params.mle < chunk) {
+        chunk = params.mle;
+    }
+
+    for (uint16_t offset = 0; offset < total; ) {
+        uint8_t le = (total - offset < chunk) ? total - offset : chunk;
+        int16_t status = _nfc->type4_read_binary(2 + offset, le, entry->content + offset);
+        if (status <= 0) {
+            return false;
+        }
+        offset += status;
+    }
+
+    entry->fileId = params.fileId;
+    entry->length = total;
+
+    uint8_t probe = total < TAG_CACHE_TYPE4_PROBE ? total : TAG_CACHE_TYPE4_PROBE;
+    entry->check = hash(hash(HASH_INIT, nlen, 2), entry->content, probe);
+
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Gives the NDEF message of the inlisted Type 4 Tag.  A cached message
+    is used if NLEN and the first TAG_CACHE_TYPE4_PROBE bytes didn't
+    change: 3 exchanges (application, file, READ BINARY).
+
+    @param  uid         Uid of the tag
+    @param  uidLen      Length of the uid
+    @param  length      Length of the message (out)
+
+    @returns the message, valid until the next call, 0 for an error or a
+             message longer than TAG_CACHE_CONTENT_SIZE
+*/
+/**************************************************************************/
+const uint8_t *TagCache::type4_ReadNDEF(const uint8_t *uid, uint8_t uidLen, uint16_t *length)
+{
+    if (!_nfc->type4_select_ndef_application()) {
+        return 0;
+    }
+
+    tag_cache_entry_t *entry = lookup(uid, uidLen, TAG_CACHE_TYPE4, 0);
+    uint32_t check;
+
+    if (entry && type4Probe(entry, &check) && check == entry->check) {
+        _hits++;
+        *length = entry->length;
+        return entry->content;
+    }
+
+    _misses++;
+    entry = store(entry, uid, uidLen, TAG_CACHE_TYPE4, 0);
+    if (!entry || !type4Read(entry)) {
+        return 0;
+    }
+
+    entry->uidLength = uidLen;
+    *length = entry->length;
+
+    return entry->content;
+}
@@ -0,0 +1,105 @@
+/**************************************************************************/
+/*!
+    @file     tag_cache.h
+    @license  BSD
+
+    Keeps the content of recently seen tags, keyed by uid and card
+    family, so a badge tapped again is not read in full.  Before an
+    entry is reused, a cheap check tells whether the tag changed:
+
+    - NTAG21x: the NFC counter (READ_CNT), which only moves when the tag
+      is read (NFC_CNT_EN set in its configuration); 1 exchange
+    - Mifare Classic: checksum of the sector trailer (access bits, GPB,
+      key B), so writers must bump the GPB or change a key; 2 exchanges
+    - Type 4: NLEN and a hash of the first bytes of the NDEF file;
+      3 exchanges (application, file, READ BINARY)
+
+    When the check fails, the content is read again and cached.
+*/
+/**************************************************************************/
+
+#ifndef __TAG_CACHE_H__
+#define __TAG_CACHE_H__
+
+#include "PN532.h"
+
+#ifndef TAG_CACHE_ENTRIES
+#define TAG_CACHE_ENTRIES           4   // tags kept, least recently used first out
+#endif
+
+#ifndef TAG_CACHE_CONTENT_SIZE
+#define TAG_CACHE_CONTENT_SIZE      64  // longest content kept
+#endif
+
+#define TAG_CACHE_NTAG              (1)
+#define TAG_CACHE_CLASSIC           (2)
+#define TAG_CACHE_TYPE4             (3)
+
+#define TAG_CACHE_TYPE4_PROBE       (16)    // bytes of the NDEF message hashed
+
+#define NTAG_CMD_READ_CNT           (0x39)
+#define NTAG_NFC_COUNTER            (0x02)
+
+typedef struct {
+    uint8_t uid[10];
+    uint8_t uidLength;      // 0 for a free entry
+    uint8_t family;         // TAG_CACHE_xxx
+    uint8_t index;          // sector for Classic, 0 otherwise
+    uint16_t fileId;        // NDEF file of a Type 4 Tag
+    uint32_t check;         // counter, checksum or hash of the tag
+    uint16_t used;          // time of last use, for LRU
+    uint16_t length;
+    uint8_t content[TAG_CACHE_CONTENT_SIZE];
+} tag_cache_entry_t;
+
+class TagCache {
+public:
+    TagCache(PN532 &nfc);
+
+    /**
+    * @brief    NDEF message of the inlisted NTAG21x (TLV removed)
+    * @param    uid         uid of the tag
+    * @param    uidLen      length of the uid
+    * @param    length      length of the message (out)
+    * @return   the message, valid until the next call, 0 for an error
+    *           or a message longer than TAG_CACHE_CONTENT_SIZE
+    */
+    const uint8_t *ntag_ReadNDEF(const uint8_t *uid, uint8_t uidLen, uint16_t *length);
+
+    /**
+    * @brief    data blocks of a Mifare Classic sector, trailer excluded
+    * @return   the blocks, valid until the next call, 0 for an error
+    */
+    const uint8_t *mifareclassic_ReadSector(const uint8_t *uid, uint8_t uidLen, uint8_t sectorNumber,
+                                            uint8_t keyNumber, const uint8_t *keyData, uint16_t *length);
+
+    /**
+    * @brief    NDEF message of the inlisted Type 4 Tag
+    * @return   the message, valid until the next call, 0 for an error
+    */
+    const uint8_t *type4_ReadNDEF(const uint8_t *uid, uint8_t uidLen, uint16_t *length);
+
+    void clear();
+
+    // content reused after a successful check / read in full
+    uint16_t hits() { return _hits; };
+    uint16_t misses() { return _misses; };
+
+private:
+    tag_cache_entry_t *lookup(const uint8_t *uid, uint8_t uidLen, uint8_t family, uint8_t index);
+    tag_cache_entry_t *store(tag_cache_entry_t *entry, const uint8_t *uid, uint8_t uidLen, uint8_t family, uint8_t index);
+    bool ntagCounter(uint32_t *counter);
+    bool ntagRead(tag_cache_entry_t *entry);
+    bool classicRead(tag_cache_entry_t *entry, uint8_t sectorNumber);
+    bool classicTrailer(uint8_t sectorNumber, uint32_t *checksum);
+    bool type4Probe(const tag_cache_entry_t *entry, uint32_t *check);
+    bool type4Read(tag_cache_entry_t *entry);
+
+    PN532 *_nfc;
+    tag_cache_entry_t _entries[TAG_CACHE_ENTRIES];
+    uint16_t _clock;
+    uint16_t _hits;
+    uint16_t _misses;
+};
+
+#endif
@@ -0,0 +1,83 @@
+
+#include "tag_events.h"
+#include "PN532_debug.h"
+#include "Arduino.h"
+
+#include <string.h>
+
+TagEvents::TagEvents(PN532 &nfc, uint16_t debounce)
+{
+    _nfc = &nfc;
+    _handler = 0;
+    _debounce = debounce;
+    clear();
+}
+
+uint8_t TagEvents::find(const uint8_t *uid, uint8_t uidLen)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_tags[i].uidLen == uidLen && 0 == memcmp(_tags[i].uid, uid, uidLen)) {
+            return i;
+        }
+    }
+
+    return TAG_EVENTS_NO_TAG;
+}
+
+void TagEvents::emit(uint8_t event, uint8_t index)
+{
+    if (_handler) {
+        _handler(event, _tags[index].uid, _tags[index].uidLen);
+    }
+}
+
+uint8_t TagEvents::poll(uint16_t timeout)
+{
+    unsigned long now;
+
+    if (_current != TAG_EVENTS_NO_TAG && _nfc->isTargetPresent()) {
+        _tags[_current].lastSeen = millis();
+        emit(TAG_EVENT_PRESENT, _current);
+    } else {
+        uint8_t uid[sizeof(_tags[0].uid)];
+        uint8_t uidLen;
+
+        _current = TAG_EVENTS_NO_TAG;
+        if (_nfc->readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLen, timeout, true) &&
+                uidLen <= sizeof(uid)) {
+            uint8_t index = find(uid, uidLen);
+
+            if (index != TAG_EVENTS_NO_TAG) {
+                // Back within the debounce time, still the same tap
+                _tags[index].lastSeen = millis();
+                emit(TAG_EVENT_PRESENT, index);
+            } else if (_count < TAG_EVENTS_MAX) {
+                index = _count++;
+                memcpy(_tags[index].uid, uid, uidLen);
+                _tags[index].uidLen = uidLen;
+                _tags[index].lastSeen = millis();
+                emit(TAG_EVENT_ARRIVED, index);
+            } else {
+                DMSG("Too many cards to track\n");
+            }
+            _current = index;
+        }
+    }
+
+    now = millis();
+    for (uint8_t i = 0; i < _count; ) {
+        if (i == _current || now - _tags[i].lastSeen <= _debounce) {
+            i++;
+            continue;
+        }
+
+        emit(TAG_EVENT_DEPARTED, i);
+        _count--;
+        _tags[i] = _tags[_count];
+        if (_current == _count) {
+            _current = i;
+        }
+    }
+
+    return _count;
+}
@@ -0,0 +1,73 @@
+/**************************************************************************/
+/*!
+    @file     tag_events.h
+    @license  BSD
+
+    Turns polling into arrived / present / departed events, so a tap is
+    handled once.  A card already seen is followed with the cheap
+    presence check of PN532 instead of a new anticollision.
+*/
+/**************************************************************************/
+
+#ifndef __TAG_EVENTS_H__
+#define __TAG_EVENTS_H__
+
+#include "PN532.h"
+
+#ifndef TAG_EVENTS_MAX
+#define TAG_EVENTS_MAX              4   // cards tracked at once
+#endif
+
+#define TAG_EVENT_ARRIVED           (0)
+#define TAG_EVENT_PRESENT           (1)
+#define TAG_EVENT_DEPARTED          (2)
+
+#define TAG_EVENTS_NO_TAG           (0xFF)
+
+typedef void (*tagEventHandler)(uint8_t event, const uint8_t *uid, uint8_t uidLength);
+
+class TagEvents {
+public:
+    /**
+    * @param    nfc         PN532 polling for ISO14443A cards
+    * @param    debounce    ms a card may go unseen before it departs
+    */
+    TagEvents(PN532 &nfc, uint16_t debounce = 200);
+
+    void attach(tagEventHandler handler) { _handler = handler; };
+    void setDebounce(uint16_t debounce) { _debounce = debounce; };
+
+    /**
+    * @brief    one step: check the current card, or poll for a card if
+    *           there is none, then report the cards gone for longer than
+    *           the debounce.  Use a short activation retry count (e.g.
+    *           PN532_RF_FAST_UID_POLL) so an empty field returns quickly.
+    * @param    timeout     max time to wait for a new card, in ms
+    * @return   number of cards present
+    */
+    uint8_t poll(uint16_t timeout = 50);
+
+    uint8_t count() { return _count; };
+
+    // forget every card without departed events
+    void clear() { _count = 0; _current = TAG_EVENTS_NO_TAG; };
+
+private:
+    struct Tag {
+        uint8_t uid[10];
+        uint8_t uidLen;
+        unsigned long lastSeen;
+    };
+
+    uint8_t find(const uint8_t *uid, uint8_t uidLen);
+    void emit(uint8_t event, uint8_t index);
+
+    PN532 *_nfc;
+    tagEventHandler _handler;
+    uint16_t _debounce;
+    Tag _tags[TAG_EVENTS_MAX];
+    uint8_t _count;
+    uint8_t _current;   // index of the inlisted card, or TAG_EVENTS_NO_TAG
+};
+
+#endif
@@ -84,11 +84,16 @@ int8_t PN532_HSU::writeCommand(const uint8_t *header, uint8_t hlen, const uint8_
 int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
 {
     uint8_t tmp[3];
+    int16_t ret;
     
     DMSG("\nRead:  ");
     
     /** Frame Preamble and Start Code */
-    if(receive(tmp, 3, timeout)<=0){
+    ret = receive(tmp, 3, timeout);
+    if(PN532_CANCELLED == ret){
+        return abort();
+    }
+    if(ret<=0){
         return PN532_TIMEOUT;
     }
     if(0 != tmp[0] || 0!= tmp[1] || 0xFF != tmp[2]){
@@ -98,7 +103,11 @@ int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
     
     /** receive length and check */
     uint8_t length[2];
-    if(receive(length, 2, timeout) <= 0){
+    ret = receive(length, 2, timeout);
+    if(PN532_CANCELLED == ret){
+        return abort();
+    }
+    if(ret <= 0){
         return PN532_TIMEOUT;
     }
     if( 0 != (uint8_t)(length[0] + length[1]) ){
@@ -112,7 +121,11 @@ int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
     
     /** receive command byte */
     uint8_t cmd = command + 1;               // response command
-    if(receive(tmp, 2, timeout) <= 0){
+    ret = receive(tmp, 2, timeout);
+    if(PN532_CANCELLED == ret){
+        return abort();
+    }
+    if(ret <= 0){
         return PN532_TIMEOUT;
     }
     if( PN532_PN532TOHOST != tmp[0] || cmd != tmp[1]){
@@ -120,7 +133,11 @@ int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
         return PN532_INVALID_FRAME;
     }
     
-    if(receive(buf, length[0], timeout) != length[0]){
+    ret = receive(buf, length[0], timeout);
+    if(PN532_CANCELLED == ret){
+        return abort();
+    }
+    if(ret != length[0]){
         return PN532_TIMEOUT;
     }
     uint8_t sum = PN532_PN532TOHOST + cmd;
@@ -129,7 +146,11 @@ int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
     }
     
     /** checksum and postamble */
-    if(receive(tmp, 2, timeout) <= 0){
+    ret = receive(tmp, 2, timeout);
+    if(PN532_CANCELLED == ret){
+        return abort();
+    }
+    if(ret <= 0){
         return PN532_TIMEOUT;
     }
     if( 0 != (uint8_t)(sum + tmp[0]) || 0 != tmp[1] ){
@@ -140,6 +161,37 @@ int16_t PN532_HSU::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
     return length[0];
 }
 
+/**
+    @brief abort the pending command with an ACK frame, then drop what
+           the PN532 sent of its response, until the line stays quiet
+           for PN532_HSU_DRAIN_TIME ms, so it can't be taken for the
+           response of the next command.
+    @retval PN532_CANCELLED
+*/
+int16_t PN532_HSU::abort()
+{
+    writeAckFrame();
+
+    unsigned long quiet = millis();
+    while ((millis() - quiet) < PN532_HSU_DRAIN_TIME) {
+        if (_serial->available()) {
+            _serial->read();
+            quiet = millis();
+        }
+    }
+
+    return PN532_CANCELLED;
+}
+
+void PN532_HSU::writeAckFrame()
+{
+    const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
+
+    _serial->write(PN532_ACK, sizeof(PN532_ACK));
+
+    DMSG("\nCommand aborted\n");
+}
+
 int8_t PN532_HSU::readAckFrame()
 {
     const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
@@ -164,9 +216,10 @@ int8_t PN532_HSU::readAckFrame()
     @param buf --> return value buffer.
            len --> length expect to receive.
            timeout --> time of reveiving
-    @retval number of received bytes, 0 means no data received.
+    @retval number of received bytes, 0 means no data received,
+            PN532_CANCELLED if the cancel flag was set while waiting.
 */
-int8_t PN532_HSU::receive(uint8_t *buf, int len, uint16_t timeout)
+int16_t PN532_HSU::receive(uint8_t *buf, int len, uint16_t timeout)
 {
   int read_bytes = 0;
   int ret;
@@ -179,6 +232,9 @@ int8_t PN532_HSU::receive(uint8_t *buf, int len, uint16_t timeout)
       if (ret >= 0) {
         break;
      }
+      if (cancelled()) {
+        return PN532_CANCELLED;
+      }
     } while((timeout == 0) || ((millis()- start_millis ) < timeout));
     
     if (ret < 0) {
@@ -8,6 +8,7 @@
 #define PN532_HSU_DEBUG
 
 #define PN532_HSU_READ_TIMEOUT						(1000)
+#define PN532_HSU_DRAIN_TIME						(5)     // ms of silence ending an aborted frame
 
 class PN532_HSU : public PN532Interface {
 public:
@@ -23,8 +24,10 @@ private:
     uint8_t command;
     
     int8_t readAckFrame();
+    void writeAckFrame();
+    int16_t abort();
     
-    int8_t receive(uint8_t *buf, int len, uint16_t timeout=PN532_HSU_READ_TIMEOUT);
+    int16_t receive(uint8_t *buf, int len, uint16_t timeout=PN532_HSU_READ_TIMEOUT);
 };
 
 #endif
@@ -86,10 +86,15 @@ int16_t PN532_I2C::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
             }
         }
 
+        if (cancelled()) {
+            writeAckFrame();
+            return PN532_CANCELLED;
+        }
+
         delay(1);
         time++;
         if ((0 != timeout) && (time > timeout)) {
-            return -1;
+            return PN532_TIMEOUT;
         }
     } while (1); 
     
@@ -138,6 +143,19 @@ int16_t PN532_I2C::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
     return length;
 }
 
+void PN532_I2C::writeAckFrame()
+{
+    const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
+
+    _wire->beginTransmission(PN532_I2C_ADDRESS);
+    for (uint8_t i = 0; i < sizeof(PN532_ACK); i++) {
+        write(PN532_ACK[i]);
+    }
+    _wire->endTransmission();
+
+    DMSG("Command aborted\n");
+}
+
 int8_t PN532_I2C::readAckFrame()
 {
     const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
@@ -19,6 +19,7 @@ private:
     uint8_t command;
     
     int8_t readAckFrame();
+    void writeAckFrame();
     
     inline uint8_t write(uint8_t data) {
         #if ARDUINO >= 100
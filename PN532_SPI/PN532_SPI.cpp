@@ -64,6 +64,10 @@ int16_t PN532_SPI::readResponse(uint8_t buf[], uint8_t len, uint16_t timeout)
 {
     uint16_t time = 0;
     while (!isReady()) {
+        if (cancelled()) {
+            writeAckFrame();
+            return PN532_CANCELLED;
+        }
         delay(1);
         time++;
         if (timeout > 0 && time > timeout) {
@@ -190,6 +194,23 @@ void PN532_SPI::writeFrame(const uint8_t *header, uint8_t hlen, const uint8_t *b
     DMSG('\n');
 }
 
+void PN532_SPI::writeAckFrame()
+{
+    const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
+
+    digitalWrite(_ss, LOW);
+    delay(2);               // wake up PN532
+
+    write(DATA_WRITE);
+    for (uint8_t i = 0; i < sizeof(PN532_ACK); i++) {
+        write(PN532_ACK[i]);
+    }
+
+    digitalWrite(_ss, HIGH);
+
+    DMSG("Command aborted\n");
+}
+
 int8_t PN532_SPI::readAckFrame()
 {
     const uint8_t PN532_ACK[] = {0, 0, 0xFF, 0, 0xFF, 0};
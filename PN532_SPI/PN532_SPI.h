@@ -23,6 +23,7 @@ private:
     boolean isReady();
     void writeFrame(const uint8_t *header, uint8_t hlen, const uint8_t *body = 0, uint8_t blen = 0);
     int8_t readAckFrame();
+    void writeAckFrame();
     
     inline void write(uint8_t data) {
         _spi->transfer(data);